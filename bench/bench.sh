@@ -0,0 +1,194 @@
+#!/bin/bash
+
+set -o errexit
+set -o nounset
+set -o pipefail
+
+# Throughput and latency benchmarks
+#
+# Each run reads a generated file and writes to pipes drained by cat(1).
+# Results are written as a table:
+#
+#   lines/s, MB/s: input lines and bytes per second (wall clock)
+#   cpu ns/line: user and system time per line
+#   p50, p99, p99.9: upper bound of the latency histogram bucket (see
+#                    --stats) in microseconds
+#
+# Environment:
+#
+#   BENCH_LINES: number of lines in each input (default: 200000)
+#   BENCH_BACKENDS: process restrictions to compare (default: depends on
+#                   the OS)
+#   RESTRICT_PROCESS: process restriction used for all other runs
+
+BENCH="$(cd "$(dirname "$0")" && pwd)"
+TOP="$(dirname "$BENCH")"
+
+LINES="${BENCH_LINES-200000}"
+
+case "$(uname -s)" in
+Linux)
+  DEFAULT_BACKEND=seccomp
+  BACKENDS="null rlimit seccomp"
+  ;;
+OpenBSD)
+  DEFAULT_BACKEND=pledge
+  BACKENDS="null rlimit pledge"
+  ;;
+FreeBSD)
+  DEFAULT_BACKEND=capsicum
+  BACKENDS="null rlimit capsicum"
+  ;;
+*)
+  DEFAULT_BACKEND=rlimit
+  BACKENDS="null rlimit"
+  ;;
+esac
+
+BACKEND="${RESTRICT_PROCESS-$DEFAULT_BACKEND}"
+BACKENDS="${BENCH_BACKENDS-$BACKENDS}"
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+build() {
+  "${CC-cc}" -O2 -o "$WORK/tsgen" "$BENCH/tsgen.c"
+
+  for backend in $BACKENDS $BACKEND; do
+    [ -x "$WORK/tscat-$backend" ] && continue
+    make -s -C "$TOP" PROG="$WORK/tscat-$backend" \
+      RESTRICT_PROCESS="$backend" "$WORK/tscat-$backend"
+  done
+}
+
+generate() {
+  "$WORK/tsgen" fixed "$LINES" >"$WORK/fixed"
+  "$WORK/tsgen" variable "$LINES" >"$WORK/variable"
+  # lines of 12368 bytes: 1/50 of the lines for a similar input size
+  "$WORK/tsgen" long "$((LINES / 50 + 1))" >"$WORK/long"
+  "$WORK/tsgen" binary "$LINES" >"$WORK/binary"
+}
+
+# percentile <fraction>: latency histogram bucket containing the
+# percentile
+percentile() {
+  awk -v p="$1" '/latency_us/ {
+    total = 0
+    for (i = 4; i <= NF; i++) {
+      split($i, kv, "=")
+      total += kv[2]
+    }
+    n = 0
+    for (i = 4; i <= NF; i++) {
+      split($i, kv, "=")
+      n += kv[2]
+      if (n >= p * total) {
+        print kv[1]
+        exit
+      }
+    }
+  }' "$WORK/stats"
+}
+
+header() {
+  printf "\n# %s\n" "$1"
+  printf "%-9s %-9s %-30s %11s %8s %12s %9s %9s %9s\n" \
+    backend input options lines/s MB/s "cpu ns/line" p50 p99 p99.9
+}
+
+# run <backend> <input> <options> <command> ...
+run() {
+  local backend="$1"
+  local input="$2"
+  local options="$3"
+  shift 3
+
+  local lines
+  local bytes
+  local result
+
+  lines="$(wc -l <"$WORK/$input")"
+  bytes="$(wc -c <"$WORK/$input")"
+
+  : >"$WORK/stats"
+
+  result="$({
+    TIMEFORMAT="%R %U %S"
+    time "$@" <"$WORK/$input" > >(cat >/dev/null) 2> >(cat >/dev/null) \
+      3>"$WORK/stats" || echo "exit status $?"
+  } 2>&1)"
+
+  # -W exit: the consumer may not keep up
+  case "$result" in
+  *"exit status"*)
+    printf "%-9s %-9s %-30s %11s\n" "$backend" "$input" "$options" \
+      "${result##*$'\n'}"
+    return
+    ;;
+  esac
+
+  echo "$result" |
+    awk -v backend="$backend" -v input="$input" -v options="$options" \
+      -v lines="$lines" -v bytes="$bytes" \
+      -v p50="$(percentile 0.5)" -v p99="$(percentile 0.99)" \
+      -v p999="$(percentile 0.999)" '{
+        real = $1 > 0 ? $1 : 0.001
+        printf("%-9s %-9s %-30s %11.0f %8.1f %12.0f %9s %9s %9s\n",
+          backend, input, options, lines / real, bytes / real / 1e6,
+          ($2 + $3) * 1e9 / lines,
+          p50 == "" ? "-" : p50, p99 == "" ? "-" : p99,
+          p999 == "" ? "-" : p999)
+      }'
+}
+
+# tscat <backend> <input> <option> ...
+tscat() {
+  local backend="$1"
+  local input="$2"
+  shift 2
+
+  run "$backend" "$input" "$*" "$WORK/tscat-$backend" --stats=3 "$@"
+}
+
+build
+generate
+
+header "baseline"
+run awk fixed "bench/tscat.awk" "$BENCH/tscat.awk"
+tscat "$BACKEND" fixed -o 3
+
+header "input"
+for input in fixed variable long binary; do
+  tscat "$BACKEND" "$input"
+done
+
+header "output"
+for output in 1 2 3; do
+  tscat "$BACKEND" fixed -o "$output"
+done
+
+header "write error"
+for policy in block drop exit queue=1048576; do
+  tscat "$BACKEND" fixed -W "$policy"
+done
+
+header "format"
+for format in "" "%FT%T%z" "%s.%N" "%F %T.%6N %Z"; do
+  tscat "$BACKEND" fixed --format="$format"
+done
+
+header "output format"
+for format in text json logfmt; do
+  tscat "$BACKEND" variable --output-format="$format"
+done
+
+header "flush"
+tscat "$BACKEND" fixed --flush=line
+tscat "$BACKEND" fixed --flush=batch
+tscat "$BACKEND" fixed --flush=100
+tscat "$BACKEND" fixed --threads --flush=batch
+
+header "process restriction"
+for backend in $BACKENDS; do
+  tscat "$backend" fixed
+done
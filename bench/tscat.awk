@@ -0,0 +1,11 @@
+#!/bin/sh
+
+# Baseline: the awk alternative from the README.
+
+LABEL="${1-""}"
+exec awk -v service="$LABEL" '{
+  t = strftime("%FT%T%z")
+  printf("%s %s %s\n", t, service, $0) > "/dev/stderr"
+  printf("%s %s %s\n", t, service, $0)
+  fflush()
+}'
@@ -0,0 +1,135 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Generate synthetic input for benchmarks.
+ *
+ * tsgen <fixed|variable|long|binary> <lines> [<size>]
+ *
+ * fixed: lines of size bytes (default: 80)
+ * variable: lines of 1 to 2 * size bytes
+ * long: lines of 3 * 4096 + size bytes, split by the reader
+ * binary: random bytes, including NUL, with a newline every 1 to
+ *         2 * size bytes
+ *
+ * The output is the same for every run.
+ */
+
+enum { TSGEN_FIXED = 0, TSGEN_VARIABLE, TSGEN_LONG, TSGEN_BINARY };
+
+static uint64_t tsgen_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t tsgen_random(void);
+static void usage(void);
+
+extern char *__progname;
+
+int main(int argc, char *argv[]) {
+  static const char alphabet[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 =:,.";
+  char *buf;
+  long long lines;
+  long long i;
+  size_t size = 80;
+  size_t len;
+  size_t n;
+  int mode;
+
+  if (argc < 3) {
+    usage();
+    exit(2);
+  }
+
+  if (strcmp(argv[1], "fixed") == 0)
+    mode = TSGEN_FIXED;
+  else if (strcmp(argv[1], "variable") == 0)
+    mode = TSGEN_VARIABLE;
+  else if (strcmp(argv[1], "long") == 0)
+    mode = TSGEN_LONG;
+  else if (strcmp(argv[1], "binary") == 0)
+    mode = TSGEN_BINARY;
+  else {
+    usage();
+    exit(2);
+  }
+
+  lines = strtoll(argv[2], NULL, 10);
+  if (lines <= 0)
+    errx(2, "invalid number of lines: %s", argv[2]);
+
+  if (argc > 3) {
+    size = strtoul(argv[3], NULL, 10);
+    if (size == 0 || size > 1024 * 1024)
+      errx(2, "invalid size: %s", argv[3]);
+  }
+
+  buf = malloc(3 * 4096 + 2 * size + 1);
+  if (buf == NULL)
+    err(EXIT_FAILURE, "malloc");
+
+  for (i = 0; i < lines; i++) {
+    switch (mode) {
+    case TSGEN_FIXED:
+      len = size;
+      break;
+    case TSGEN_LONG:
+      len = 3 * 4096 + size;
+      break;
+    default:
+      len = 1 + tsgen_random() % (2 * size);
+      break;
+    }
+
+    for (n = 0; n < len; n++) {
+      uint64_t r = tsgen_random();
+
+      if (mode == TSGEN_BINARY) {
+        buf[n] = (char)(r >> 32);
+        if (buf[n] == '\n')
+          buf[n] = '\0';
+      } else
+        buf[n] = alphabet[r % (sizeof(alphabet) - 1)];
+    }
+
+    buf[len] = '\n';
+
+    if (fwrite(buf, 1, len + 1, stdout) != len + 1)
+      err(EXIT_FAILURE, "fwrite");
+  }
+
+  if (fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "fflush");
+
+  return 0;
+}
+
+/* xorshift64* */
+static uint64_t tsgen_random(void) {
+  tsgen_state ^= tsgen_state >> 12;
+  tsgen_state ^= tsgen_state << 25;
+  tsgen_state ^= tsgen_state >> 27;
+  return tsgen_state * 0x2545f4914f6cdd1dULL;
+}
+
+static void usage(void) {
+  (void)fprintf(stderr,
+                "usage: %s <fixed|variable|long|binary> <lines> [<size>]\n",
+                __progname);
+}
@@ -1,3 +1,18 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
 /*	$NetBSD: getline.c,v 1.1.1.6 2015/01/02 20:34:27 christos Exp $	*/
 
 /*	NetBSD: getline.c,v 1.2 2014/09/16 17:23:50 christos Exp 	*/
@@ -35,54 +50,153 @@
  * https://raw.githubusercontent.com/openssh/openssh-portable/872517ddbb72deaff31d4760f28f2b0a1c16358f/openbsd-compat/bsd-getline.c
  */
 /* NETBSD ORIGINAL: external/bsd/file/dist/src/getline.c */
-
 #include <errno.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-ssize_t getndelim(char **buf, size_t *bufsiz, size_t nmax, int delimiter,
-                  FILE *fp) {
-  char *ptr, *eptr;
+#include "getnline.h"
+
+int getnline_init(getnline_t *r, int fd, size_t size) {
+  (void)memset(r, 0, sizeof(*r));
+
+  if (size == 0)
+    size = GETNLINE_BUFSIZ;
+
+  r->buf = malloc(size);
+  if (r->buf == NULL)
+    return -1;
+
+  r->fd = fd;
+  r->size = size;
+
+  return 0;
+}
+
+void getnline_free(getnline_t *r) {
+  free(r->buf);
+  r->buf = NULL;
+  r->size = 0;
+}
 
-  if (*buf == NULL || *bufsiz == 0) {
-    if ((*buf = malloc(BUFSIZ)) == NULL)
-      return -1;
-    *bufsiz = BUFSIZ;
+/* Read the next block of input into the buffer.
+ *
+ * Any partial record is moved to the start of the buffer first so the
+ * read is always as large as the free space allows.
+ *
+ * Returns the number of bytes read, 0 on end of file or -1 on error.
+ */
+ssize_t getnline_read(getnline_t *r) {
+  char *buf;
+  ssize_t n;
+
+  if (r->eof)
+    return 0;
+
+  n = getnline_space(r, &buf);
+  if (n < 0)
+    return -1;
+
+  do {
+    n = read(r->fd, buf, n);
+  } while (n == -1 && errno == EINTR);
+
+  getnline_commit(r, n);
+
+  return n;
+}
+
+/* The free space for the next read: the caller reads into the buffer
+ * and calls getnline_commit() with the result.
+ *
+ * Returns the size of the free space or -1 if the buffer is full.
+ */
+ssize_t getnline_space(getnline_t *r, char **buf) {
+  if (r->off > 0) {
+    if (r->len > 0)
+      (void)memmove(r->buf, r->buf + r->off, r->len);
+    r->off = 0;
   }
 
-  for (ptr = *buf, eptr = *buf + *bufsiz;;) {
-    int c = fgetc(fp);
-    if (c == -1) {
-      if (feof(fp)) {
-        ssize_t diff = (ssize_t)(ptr - *buf);
-        if (diff != 0) {
-          *ptr = '\0';
-          return diff;
-        }
-      }
-      return -1;
-    }
-    *ptr++ = c;
-    if (c == delimiter || ((ptr - *buf > 0) && ((size_t)(ptr - *buf) >= nmax))) {
-      *ptr = '\0';
-      return ptr - *buf;
-    }
-    if (ptr + 2 >= eptr) {
-      char *nbuf;
-      size_t nbufsiz = *bufsiz * 2;
-      ssize_t d = ptr - *buf;
-      if ((nbuf = realloc(*buf, nbufsiz)) == NULL)
-        return -1;
-      *buf = nbuf;
-      *bufsiz = nbufsiz;
-      eptr = nbuf + nbufsiz;
-      ptr = nbuf + d;
-    }
+  if (r->len == r->size) {
+    errno = ENOBUFS;
+    return -1;
   }
+
+  *buf = r->buf + r->len;
+  return r->size - r->len;
+}
+
+/* n: the number of bytes read, 0 on end of file */
+void getnline_commit(getnline_t *r, ssize_t n) {
+  if (n == 0)
+    r->eof = 1;
+  else if (n > 0)
+    r->len += n;
+}
+
+/* Return the next record from the buffer.
+ *
+ * A record ends with the delimiter or is nmax bytes long. At end of file,
+ * the remaining bytes are returned as the final record.
+ *
+ * The record points into the reader buffer and is not NUL terminated. It
+ * is valid until the next call to getnline_read().
+ *
+ * Returns the record length or 0 if more input is required (or, if eof is
+ * set, no input remains).
+ */
+ssize_t getndelim(getnline_t *r, char **line, size_t nmax, int delimiter) {
+  char *p;
+  size_t limit;
+  size_t n;
+
+  if (nmax == 0 || nmax > r->size)
+    nmax = r->size;
+
+  limit = r->len < nmax ? r->len : nmax;
+
+  p = memchr(r->buf + r->off + r->scan, delimiter, limit - r->scan);
+
+  if (p != NULL)
+    n = (size_t)(p - (r->buf + r->off)) + 1;
+  else if (limit == nmax || (r->eof && limit > 0))
+    n = limit;
+  else {
+    r->scan = limit;
+    return 0;
+  }
+
+  *line = r->buf + r->off;
+  r->off += n;
+  r->len -= n;
+  r->scan = 0;
+
+  return n;
+}
+
+ssize_t getnline(getnline_t *r, char **line, size_t nmax) {
+  return getndelim(r, line, nmax, '\n');
 }
 
-ssize_t getnline(char **buf, size_t *bufsiz, size_t nmax, FILE *fp) {
-  return getndelim(buf, bufsiz, nmax, '\n', fp);
+/* Return the next n bytes from the buffer.
+ *
+ * The bytes are valid until the next call to getnline_read().
+ *
+ * Returns n, 0 if more input is required or, if eof is set, the number of
+ * bytes remaining.
+ */
+ssize_t getnbytes(getnline_t *r, char **buf, size_t n) {
+  if (r->len < n) {
+    if (!r->eof)
+      return 0;
+    n = r->len;
+  }
+
+  *buf = r->buf + r->off;
+  r->off += n;
+  r->len -= n;
+  r->scan = 0;
+
+  return n;
 }
@@ -1,3 +1,60 @@
-ssize_t getndelim(char **buf, size_t *bufsiz, size_t nmax, int delimiter,
-                  FILE *fp);
-ssize_t getnline(char **buf, size_t *bufsiz, size_t nmax, FILE *fp);
+/*	$NetBSD: getline.c,v 1.1.1.6 2015/01/02 20:34:27 christos Exp $	*/
+
+/*	NetBSD: getline.c,v 1.2 2014/09/16 17:23:50 christos Exp 	*/
+
+/*-
+ * Copyright (c) 2011 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Christos Zoulas.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* openssh-portable:
+ * https://raw.githubusercontent.com/openssh/openssh-portable/872517ddbb72deaff31d4760f28f2b0a1c16358f/openbsd-compat/bsd-getline.c
+ */
+/* NETBSD ORIGINAL: external/bsd/file/dist/src/getline.c */
+
+#include <sys/types.h>
+
+#define GETNLINE_BUFSIZ 65536
+
+typedef struct {
+  int fd;
+  char *buf;
+  size_t size;
+  size_t off;
+  size_t len;
+  size_t scan;
+  int eof;
+} getnline_t;
+
+int getnline_init(getnline_t *r, int fd, size_t size);
+void getnline_free(getnline_t *r);
+ssize_t getnline_read(getnline_t *r);
+ssize_t getnline_space(getnline_t *r, char **buf);
+void getnline_commit(getnline_t *r, ssize_t n);
+ssize_t getndelim(getnline_t *r, char **line, size_t nmax, int delimiter);
+ssize_t getnline(getnline_t *r, char **line, size_t nmax);
+ssize_t getnbytes(getnline_t *r, char **buf, size_t n);
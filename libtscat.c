@@ -0,0 +1,2089 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tscat_int.h"
+#include "strtonum.h"
+#include "tsbin.h"
+#include "tsescape.h"
+
+/* Maximum record size: records are written directly from the read
+ * buffer.
+ */
+#define TS_CHUNK 16384
+
+/* Linux: pipes are enlarged to this size if the limit allows */
+#define TS_PIPE_SIZE (1024 * 1024)
+
+/* Output buffer size for regular files */
+#define TS_FILE_BUFSIZ (1024 * 1024)
+
+/* threads: milliseconds between checks for queued input while an output
+ * is blocked
+ */
+#define TS_QUEUE_POLL_INTERVAL 10
+
+/* Milliseconds an input writing a line holds the output before the line
+ * is terminated and the other inputs are read
+ */
+#define TS_OWNER_TIMEOUT 1000
+
+/* io: user data of the input read, writes use the output index */
+#define TS_URING_READ UINT64_MAX
+
+static void tscatfree(ts_state_t *s);
+static int tscatinputinit(ts_input_t *in, const char *label);
+static int tscatpipesize(ts_state_t *s, int fd);
+static int tscatnonblock(int fd);
+static int tscatlabel(ts_state_t *s, int id, const char *buf, size_t n);
+static int tscatread(ts_state_t *s, ts_input_t *in);
+static int tscatrecords(ts_state_t *s, ts_input_t *in);
+static int tscatlimit(ts_state_t *s, ts_input_t *in, const struct timespec *now,
+                      const struct timespec *mono, char *buf, size_t n);
+static int tscatsuppressed(ts_state_t *s, ts_input_t *in,
+                           const struct timespec *now,
+                           const struct timespec *mono);
+static size_t tscatnmax(ts_state_t *s, ts_input_t *in);
+static int tscatline(ts_state_t *s, ts_input_t *in, const struct timespec *now,
+                     char *buf, size_t n);
+static int tscatrecord(ts_state_t *s, ts_input_t *in,
+                       const struct timespec *now, char *buf, size_t n);
+static int tscatout(ts_state_t *s, ts_input_t *in, const struct timespec *now,
+                    char *buf, size_t buflen);
+static size_t tscatencode(ts_state_t *s, ts_input_t *in, const char *buf,
+                          size_t n);
+static char *tscatfield(ts_state_t *s, char *p, const char *key,
+                        const char *val, size_t len);
+static size_t tscatbinary(ts_state_t *s, ts_input_t *in,
+                          const struct timespec *now, size_t n);
+static size_t tscatlabels(ts_state_t *s, char *p);
+static int tscatrotate(ts_state_t *s, size_t n);
+static const struct timespec *tscatrelative(ts_state_t *s,
+                                            const struct timespec *now,
+                                            struct timespec *elapsed);
+static void tscatelapsed(const struct timespec *base,
+                         const struct timespec *now, struct timespec *elapsed);
+static int tscatmarker(void *arg, char *buf, size_t size, size_t dropped,
+                       size_t droppedlen);
+static int tscatprefix(ts_state_t *s, const struct timespec *now);
+static int tscattimeout(ts_state_t *s);
+static int tscatwait(ts_state_t *s);
+static int tscatready(ts_state_t *s);
+static void tscatpollin(ts_state_t *s);
+static int tscatheld(ts_state_t *s);
+static int tscatrelease(ts_state_t *s);
+static int tscatlimited(ts_state_t *s);
+static int tscatreport(ts_state_t *s);
+static int tscatrevents(ts_state_t *s);
+static int tscatpoll(ts_state_t *s, int input, int timeout);
+static int tscatdrain(ts_state_t *s);
+static int tscatblocked(ts_state_t *s);
+static int tscatflush(ts_state_t *s);
+static int tscatflushout(tsout_t *o);
+static int tscaturingout(ts_state_t *s, const tsout_t *o);
+static int tscaturingin(ts_state_t *s);
+static int tscaturingflush(ts_state_t *s, int line);
+static int tscaturingwait(ts_state_t *s, unsigned n, int read);
+
+/* A library stream: the caller writes to a single unlabeled input. The
+ * outputs are the sinks added before the first write.
+ *
+ * format: strftime(3) format of the timestamp, NULL for the default
+ * label: NULL or "" for no label
+ */
+tscat_t *tscat_open(const char *format, const char *label) {
+  ts_state_t *s;
+  ts_input_t *in;
+  time_t now;
+
+  s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  tscatdefaults(s);
+
+  /* the caller's pipes are not resized */
+  s->output = 0;
+  s->pipe_size = 0;
+
+  now = time(NULL);
+  if (now == -1 || tstime_init(&s->tz, now) < 0)
+    goto ERR;
+
+  /* the compiled format refers to the format string */
+  s->format = strdup(format == NULL ? "%FT%T%z" : format);
+  if (s->format == NULL || tsformat_compile(&s->fmt, s->format) < 0)
+    goto ERR;
+
+  if (clock_gettime(s->clock, &s->start) < 0)
+    goto ERR;
+
+  s->prev = s->start;
+
+  in = tscatnewinput(s);
+  if (in == NULL)
+    goto ERR;
+
+  s->nin++;
+
+  if (tscatinputinit(in, label == NULL ? "" : label) < 0)
+    goto ERR;
+
+  s->active = s->nin;
+
+  return s;
+
+ERR:
+  tscatfree(s);
+  return NULL;
+}
+
+/* Add an output. Sinks cannot be added after the first write.
+ *
+ * write_error: block, drop, exit or queue=<bytes>, NULL to block
+ */
+int tscat_sink(tscat_t *s, int fd, const char *write_error) {
+  tsout_t *o;
+
+  if (s->fds != NULL) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  o = tscatnewout(s);
+  if (o == NULL)
+    return -1;
+
+  o->fd = fd;
+
+  if (write_error != NULL &&
+      tscatpolicy(write_error, &o->write_error, &o->size) < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  s->nout++;
+
+  return 0;
+}
+
+/* Write a buffer: each complete record is timestamped and written to the
+ * sinks. A partial record is held until the record is complete or the
+ * stream is closed.
+ *
+ * Sinks to pipes and terminals are written after every line. Regular
+ * files are written when the buffer is full or the stream is flushed.
+ */
+int tscat_write(tscat_t *s, const char *buf, size_t n) {
+  ts_input_t *in = &s->in[0];
+  char *p;
+  ssize_t len;
+
+  /* the outputs are initialized by the first write */
+  if (s->fds == NULL && tscatoutputs(s) < 0)
+    return -1;
+
+  while (n > 0) {
+    len = getnline_space(&in->r, &p);
+    if (len < 0)
+      return -1;
+
+    if ((size_t)len > n)
+      len = n;
+
+    (void)memcpy(p, buf, len);
+    getnline_commit(&in->r, len);
+
+    if (tscatrecords(s, in) < 0)
+      return -1;
+
+    buf += len;
+    n -= len;
+  }
+
+  return 0;
+}
+
+/* Write any buffered output. */
+int tscat_flush(tscat_t *s) {
+  if (s->fds == NULL)
+    return 0;
+
+  return tscatflush(s);
+}
+
+void tscat_stats(tscat_t *s, tscat_stats_t *st) {
+  int i;
+
+  (void)memset(st, 0, sizeof(*st));
+
+  st->lines = tsstats_get(&s->stats.lines);
+  st->bytes = tsstats_get(&s->stats.bytes);
+
+  for (i = 0; i < s->nout; i++) {
+    st->dropped += tsstats_get(&s->out[i].stats.dropped);
+    st->dropped_bytes += tsstats_get(&s->out[i].stats.droppedlen);
+  }
+}
+
+/* Write any partial record and buffered output and free the stream.
+ *
+ * The stream is freed even if the write fails.
+ */
+int tscat_close(tscat_t *s) {
+  ts_input_t *in = &s->in[0];
+  int rv = 0;
+  int i;
+
+  if (s->fds != NULL) {
+    getnline_commit(&in->r, 0);
+
+    if (tscatrecords(s, in) < 0 || tscatflush(s) < 0 || tscatdrain(s) < 0)
+      rv = -1;
+  }
+
+  /* the caller's descriptors are left as they were before the stream */
+  for (i = 0; i < s->nout; i++) {
+    if (s->out[i].fdflags != -1 &&
+        fcntl(s->out[i].fd, F_SETFL, s->out[i].fdflags) < 0)
+      rv = -1;
+  }
+
+  tscatfree(s);
+
+  return rv;
+}
+
+/* Defaults for the tscat command and library streams */
+void tscatdefaults(ts_state_t *s) {
+  s->output = STDOUT_FILENO;
+  s->clock = CLOCK_REALTIME;
+  s->flush = TS_FLUSH_AUTO;
+  s->delim = '\n';
+  s->pipe_size = -1;
+  s->stats_fd = -1;
+  s->max_line = 4096;
+  s->rotate.fd = -1;
+  s->rotate.count = 5;
+  s->prefixtime = -1;
+  s->tmtime = -1;
+}
+
+static void tscatfree(ts_state_t *s) {
+  int i;
+
+  for (i = 0; i < s->nin; i++) {
+    getnline_free(&s->in[i].r);
+    free(s->in[i].label);
+  }
+
+  for (i = 0; i < s->nout; i++)
+    tsout_free(&s->out[i]);
+
+  free(s->in);
+  free(s->out);
+  free(s->fds);
+  free(s->obuf);
+  tsformat_free(&s->fmt);
+  free(s->format);
+  free(s);
+}
+
+int tscatpolicy(const char *arg, int *write_error, size_t *size) {
+  const char *errstr = NULL;
+
+  if (strcmp(arg, "block") == 0)
+    *write_error = TS_WR_BLOCK;
+  else if (strcmp(arg, "drop") == 0)
+    *write_error = TS_WR_DROP;
+  else if (strcmp(arg, "exit") == 0)
+    *write_error = TS_WR_EXIT;
+  else if (strncmp(arg, "queue=", 6) == 0) {
+    *write_error = TS_WR_QUEUE;
+    *size = strtonum(arg + 6, 65536, 1 << 30, &errstr);
+    if (errstr != NULL)
+      return -1;
+  } else
+    return -1;
+
+  return 0;
+}
+
+/* Add an output: the caller increments the number of outputs. */
+tsout_t *tscatnewout(ts_state_t *s) {
+  tsout_t *o;
+
+  o = realloc(s->out, (s->nout + 1) * sizeof(tsout_t));
+  if (o == NULL)
+    return NULL;
+
+  s->out = o;
+  o = &s->out[s->nout];
+  (void)memset(o, 0, sizeof(*o));
+  o->fd = -1;
+  o->fdflags = -1;
+  o->write_error = -1;
+  o->dup = -1;
+  o->stage[0] = -1;
+  o->stage[1] = -1;
+
+  return o;
+}
+
+/* Initialize the outputs: stdout and stderr (selected by -o), followed
+ * by any sinks. Each output has an independent buffer and write error
+ * behaviour.
+ *
+ * Unless the flush mode is set, the output strategy depends on the type
+ * of descriptor: regular files are written in large blocks when input is
+ * idle, pipes and terminals after every line.
+ */
+int tscatoutputs(ts_state_t *s) {
+  tsout_t *out;
+  int nstd = 0;
+  int i;
+
+  if (s->output & STDOUT_FILENO)
+    nstd++;
+  if (s->output & STDERR_FILENO)
+    nstd++;
+
+  out = realloc(s->out, (s->nout + nstd) * sizeof(tsout_t));
+  if (out == NULL && s->nout + nstd > 0)
+    return -1;
+
+  s->out = out;
+
+  if (s->nout > 0)
+    (void)memmove(&s->out[nstd], &s->out[0], s->nout * sizeof(tsout_t));
+
+  s->nout += nstd;
+
+  (void)memset(s->out, 0, nstd * sizeof(tsout_t));
+
+  i = 0;
+  if (s->output & STDOUT_FILENO)
+    s->out[i++].fd = STDOUT_FILENO;
+  if (s->output & STDERR_FILENO)
+    s->out[i++].fd = STDERR_FILENO;
+
+  for (i = 0; i < s->nout; i++) {
+    tsout_t *o = &s->out[i];
+    int fd = o->fd;
+    int write_error = o->write_error;
+    size_t size = o->size;
+    int fdflags = -1;
+    int compress;
+    struct stat sb;
+
+    if (fstat(fd, &sb) < 0)
+      return -1;
+
+    if (i < nstd || write_error == -1) {
+      write_error = s->write_error;
+      size = s->queue_size;
+    }
+
+    /* compress: stdout and the output file are compressed */
+    compress = s->compress &&
+               ((i < nstd && fd == STDOUT_FILENO) || fd == s->rotate.fd);
+
+    /* compress: the compression queue blocks when full
+     *
+     * reformat: chunks are written in full
+     */
+    if ((compress || s->reformat) && write_error != TS_WR_BLOCK) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (write_error != TS_WR_QUEUE) {
+      size = S_ISREG(sb.st_mode) ? TS_FILE_BUFSIZ : TSOUT_BUFSIZ;
+      if (s->buffer_size > 0)
+        size = s->buffer_size;
+    }
+
+    /* Writes to regular files do not block: the file status flags,
+     * including O_APPEND, are left unchanged. The flags of other
+     * descriptors are restored when a library stream is closed.
+     */
+    if (write_error != TS_WR_BLOCK && !S_ISREG(sb.st_mode)) {
+      fdflags = tscatnonblock(fd);
+      if (fdflags < 0)
+        return -1;
+    }
+
+    if (tscatpipesize(s, fd) < 0)
+      return -1;
+
+    if (tsout_init(o, fd, write_error, size) < 0)
+      return -1;
+
+    o->fdflags = fdflags;
+    o->delim = s->delim;
+
+    if (s->output_format == TS_OUTPUT_JSON ||
+        s->output_format == TS_OUTPUT_LOGFMT) {
+      o->marker = tscatmarker;
+      o->arg = s;
+    }
+
+    o->flush = s->flush;
+    if (s->flush == TS_FLUSH_AUTO)
+      o->flush = S_ISREG(sb.st_mode) ? TS_FLUSH_BATCH : TS_FLUSH_LINE;
+
+    /* compress: each write is compressed and flushed by a thread. Writes
+     * are not limited to PIPE_BUF bytes: compressed data is not
+     * interleaved with other writers.
+     */
+    if (compress) {
+      o->z = malloc(sizeof(tscompress_t));
+      if (o->z == NULL || tscompress_init(o->z, fd, s->compress_level) < 0)
+        return -1;
+      o->atomic = o->size;
+    }
+  }
+
+  /* inputs are followed by the outputs */
+  s->fds = calloc(s->nin + s->nout, sizeof(struct pollfd));
+  if (s->fds == NULL)
+    return -1;
+
+  return 0;
+}
+
+/* Set O_NONBLOCK, keeping the other file status flags */
+/* Returns the previous file status flags. */
+static int tscatnonblock(int fd) {
+  int flags;
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags < 0)
+    return -1;
+
+  if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -1;
+
+  return flags;
+}
+
+/* Linux: enlarge a pipe to absorb bursts of input or output.
+ *
+ * By default, pipes are only enlarged and failures are ignored: the size
+ * of a pipe is limited by /proc/sys/fs/pipe-max-size. A size of 0 leaves
+ * pipes unchanged.
+ */
+static int tscatpipesize(ts_state_t *s, int fd) {
+#ifdef F_SETPIPE_SZ
+  int size = s->pipe_size == -1 ? TS_PIPE_SIZE : s->pipe_size;
+  struct stat sb;
+
+  if (size == 0)
+    return 0;
+
+  if (fstat(fd, &sb) < 0)
+    return -1;
+
+  if (!S_ISFIFO(sb.st_mode))
+    return 0;
+
+  if (s->pipe_size == -1) {
+    if (fcntl(fd, F_GETPIPE_SZ) < size)
+      (void)fcntl(fd, F_SETPIPE_SZ, size);
+    return 0;
+  }
+
+  if (fcntl(fd, F_SETPIPE_SZ, size) < 0)
+    return -1;
+#else
+  (void)s;
+  (void)fd;
+#endif
+
+  return 0;
+}
+
+/* The input is added by incrementing s->nin. */
+ts_input_t *tscatnewinput(ts_state_t *s) {
+  ts_input_t *in;
+
+  in = realloc(s->in, (s->nin + 1) * sizeof(ts_input_t));
+  if (in == NULL)
+    return NULL;
+
+  s->in = in;
+  in = &s->in[s->nin];
+  (void)memset(in, 0, sizeof(*in));
+  in->fd = -1;
+
+  return in;
+}
+
+/* Open the inputs: stdin if no inputs were added.
+ *
+ * A FIFO is opened for reading and writing: the open does not wait for a
+ * writer and the input does not reach end of file when the writers
+ * close.
+ *
+ * label: the label of any input without a label
+ */
+int tscatinputs(ts_state_t *s, const char *label) {
+  struct stat sb;
+  int i;
+
+  if (s->nin == 0) {
+    if (tscatnewinput(s) == NULL)
+      return -1;
+
+    s->in[0].fd = STDIN_FILENO;
+    s->nin++;
+  }
+
+  for (i = 0; i < s->nin; i++) {
+    ts_input_t *in = &s->in[i];
+    const char *l = in->label == NULL ? label : in->label;
+
+    if (in->path != NULL) {
+      in->fd = open(in->path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+      if (in->fd < 0)
+        return -1;
+
+      if (fstat(in->fd, &sb) < 0)
+        return -1;
+
+      if (!S_ISFIFO(sb.st_mode)) {
+        errno = EINVAL;
+        return -1;
+      }
+
+      /* a single input is read without polling */
+      if (fcntl(in->fd, F_SETFL, 0) < 0)
+        return -1;
+    }
+
+    if (tscatpipesize(s, in->fd) < 0)
+      return -1;
+
+    if (tscatinputinit(in, l) < 0)
+      return -1;
+  }
+
+  s->active = s->nin;
+
+  return 0;
+}
+
+/* Label the input and allocate the read buffer. */
+static int tscatinputinit(ts_input_t *in, const char *label) {
+  /* label, separator */
+  in->labellen = label[0] == '\0' ? 0 : strlen(label) + 1;
+  in->label = malloc(in->labellen + 1);
+  if (in->label == NULL)
+    return -1;
+
+  (void)snprintf(in->label, in->labellen + 1, "%s ", label);
+
+  if (getnline_init(&in->r, in->fd, GETNLINE_BUFSIZ) < 0)
+    return -1;
+
+  in->print_timestamp = 1;
+
+  return 0;
+}
+
+/* json, logfmt: a record, the timestamp and the longest label may be
+ * fully escaped
+ *
+ * binary: the record header may be preceded by the magic and a label
+ * record for each input
+ */
+int tscatobuf(ts_state_t *s) {
+  size_t size = TSESCAPE_MAX(TS_CHUNK + sizeof(s->prefix)) + 64;
+  size_t labellen = 0;
+  char *obuf;
+  int i;
+
+  if (s->output_format == TS_OUTPUT_TEXT)
+    return 0;
+
+  if (s->output_format == TS_OUTPUT_BINARY)
+    size = TSBIN_MAGICLEN + TSBIN_HDRLEN;
+
+  for (i = 0; i < s->nin; i++) {
+    if (s->output_format == TS_OUTPUT_BINARY)
+      size += TSBIN_HDRLEN + s->in[i].labellen;
+    else if (s->in[i].labellen > labellen)
+      labellen = s->in[i].labellen;
+  }
+
+  /* decode: labels are defined by the input */
+  for (i = 0; i < s->nlabel; i++) {
+    if (s->labels[i].labellen > labellen)
+      labellen = s->labels[i].labellen;
+  }
+
+  obuf = realloc(s->obuf, size + TSESCAPE_MAX(labellen));
+  if (obuf == NULL)
+    return -1;
+
+  s->obuf = obuf;
+
+  return 0;
+}
+
+/* Inputs are read as they become readable: the output is a single stream
+ * ordered by the time each record was read.
+ */
+int tscatin(ts_state_t *s) {
+  int i;
+
+  if (s->io == TS_IO_URING && s->nin == 1 && !s->threads &&
+      s->flush != TS_FLUSH_INTERVAL && s->rate.rate == 0)
+    return tscaturingin(s);
+
+  while (s->active > 0) {
+    if ((s->threads ? tscatready(s) : tscatwait(s)) < 0)
+      return -1;
+
+    for (i = 0; i < s->nin; i++) {
+      ts_input_t *in = &s->in[i];
+
+      if (!in->ready)
+        continue;
+
+      in->ready = 0;
+
+      if (tscatread(s, in) < 0)
+        return -1;
+    }
+  }
+
+  if (s->threads) {
+    tsring_close(&s->ring);
+    errno = pthread_join(s->writer, NULL);
+    if (errno != 0)
+      return -1;
+  } else if (tscatflush(s) < 0 || tscatdrain(s) < 0)
+    return -1;
+
+  for (i = 0; i < s->nin; i++)
+    getnline_free(&s->in[i].r);
+
+  return 0;
+}
+
+static int tscatread(ts_state_t *s, ts_input_t *in) {
+  if (getnline_read(&in->r) < 0)
+    return -1;
+
+  return tscatrecords(s, in);
+}
+
+/* Write any complete records read from the input.
+ *
+ * A line written in more than one record holds the output: until the
+ * line ends, only the input writing the line is read. An input reaching
+ * end of file in the middle of a line terminates the line if any other
+ * input remains. A line held for TS_OWNER_TIMEOUT ms is terminated.
+ */
+static int tscatrecords(ts_state_t *s, ts_input_t *in) {
+  struct timespec now;
+  struct timespec mono;
+  char nl = s->delim;
+  char *buf;
+  ssize_t n;
+  int rv;
+
+  /* threads: records are timestamped when read and queued for the
+   * writer thread
+   */
+  if (s->threads && clock_gettime(s->clock, &now) < 0)
+    return -1;
+
+  /* rate: the bucket is refilled once for the lines read */
+  if (s->rate.rate > 0) {
+    if (clock_gettime(CLOCK_MONOTONIC, &mono) < 0)
+      return -1;
+    tsrate_refill(&s->rate, &mono);
+  }
+
+  while ((n = getndelim(&in->r, &buf, tscatnmax(s, in), s->delim)) > 0) {
+    tsstats_add(&s->stats.lines, 1);
+    tsstats_add(&s->stats.bytes, n);
+
+    if (s->rate.rate > 0) {
+      rv = tscatlimit(s, in, &now, &mono, buf, n);
+      if (rv < 0)
+        return -1;
+      if (rv > 0)
+        continue;
+    }
+
+    if (tscatline(s, in, &now, buf, n) < 0)
+      return -1;
+  }
+
+  if (in->r.eof) {
+    s->active--;
+    /* rate: the last input terminates the line before the report of any
+     * suppressed lines
+     */
+    if (in->midline && (s->active > 0 || s->rate.suppressed > 0) &&
+        tscatrecord(s, in, &now, &nl, 1) < 0)
+      return -1;
+    in->midline = 0;
+    in->suppress = 0;
+
+    if (s->active == 0 && s->rate.suppressed > 0 &&
+        tscatsuppressed(s, in, &now, &mono) < 0)
+      return -1;
+  }
+
+  if (in->midline && s->owner != in)
+    s->owner_deadline = tscatmsec() + TS_OWNER_TIMEOUT;
+
+  s->owner = in->midline ? in : NULL;
+
+  return 0;
+}
+
+/* rate: returns 1 if the record is discarded without being formatted or
+ * 0 if the record is written.
+ *
+ * A line is admitted or suppressed when the line starts: the rest of the
+ * line follows. The count of suppressed lines is written at most once per
+ * second: with the next line or, if no line is read, when the second has
+ * elapsed.
+ */
+static int tscatlimit(ts_state_t *s, ts_input_t *in, const struct timespec *now,
+                      const struct timespec *mono, char *buf, size_t n) {
+  if (in->midline) {
+    tsrate_charge(&s->rate, n);
+    return 0;
+  }
+
+  if (in->suppress) {
+    in->suppress = (buf[n - 1] != s->delim);
+    return 1;
+  }
+
+  if (s->rate.suppressed > 0 && tsrate_elapsed(&s->rate, mono) >= 1000 &&
+      tscatsuppressed(s, in, now, mono) < 0)
+    return -1;
+
+  if (tsrate_take(&s->rate, n))
+    return 0;
+
+  if (s->rate.suppressed++ == 0)
+    s->rate.since = *mono;
+
+  s->limited = in;
+
+  tsstats_add(&s->stats.suppressed, 1);
+
+  in->suppress = (buf[n - 1] != s->delim);
+  return 1;
+}
+
+/* rate: write a record with the count of lines suppressed since the start
+ * of the interval
+ */
+static int tscatsuppressed(ts_state_t *s, ts_input_t *in,
+                           const struct timespec *now,
+                           const struct timespec *mono) {
+  char buf[128];
+  long long ms = tsrate_elapsed(&s->rate, mono);
+  int n;
+
+  n = snprintf(buf, sizeof(buf),
+               "tscat: suppressed %llu lines in %lld.%03llds%c",
+               s->rate.suppressed, ms / 1000, ms % 1000, s->delim);
+  if (n < 0 || (size_t)n >= sizeof(buf))
+    return -1;
+
+  s->rate.suppressed = 0;
+
+  return tscatrecord(s, in, now, buf, n);
+}
+
+/* reformat: map stdin and start a worker for each processor. The workers
+ * are started before the stdin restrictions are applied.
+ */
+int tscatreformatinit(ts_state_t *s) {
+  struct stat sb;
+  long n;
+
+  if (fstat(STDIN_FILENO, &sb) < 0)
+    return -1;
+
+  s->maplen = sb.st_size;
+
+  if (s->maplen > 0) {
+    s->map = mmap(NULL, s->maplen, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+    if (s->map == MAP_FAILED) {
+      s->map = NULL;
+      return -1;
+    }
+
+    (void)posix_madvise(s->map, s->maplen, POSIX_MADV_SEQUENTIAL);
+  }
+
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1)
+    n = 1;
+
+  return tsreformat_init(&s->rf, &s->from, &s->fmt, &s->tz, s->delim, n);
+}
+
+/* reformat: write the reformatted chunks to the outputs in input order */
+int tscatreformat(ts_state_t *s) {
+  const char *buf;
+  size_t len;
+  unsigned long long lines;
+  int rv;
+  int i;
+
+  tsreformat_input(&s->rf, s->map, s->maplen);
+
+  while ((rv = tsreformat_next(&s->rf, &buf, &len, &lines)) > 0) {
+    tsstats_add(&s->stats.lines, lines);
+
+    for (i = 0; i < s->nout; i++) {
+      if (tsout_writeall(&s->out[i], buf, len, lines) < 0)
+        return -1;
+    }
+  }
+
+  if (rv < 0)
+    return -1;
+
+  tsstats_add(&s->stats.bytes, s->maplen);
+
+  tsreformat_free(&s->rf);
+
+  if (s->map != NULL)
+    (void)munmap(s->map, s->maplen);
+
+  return tscatdrain(s);
+}
+
+/* decode: read binary records from stdin and write the records using the
+ * output format
+ *
+ * Labels are defined by label records in the input. Relative timestamps
+ * are relative to the first record.
+ */
+int tscatdecode(ts_state_t *s) {
+  ts_input_t *in = &s->in[0];
+  struct timespec now;
+  tsbin_hdr_t h = {0};
+  int magic = 0;
+  int hdr = 0;
+  int first = 1;
+  char *buf;
+  ssize_t n;
+
+  while (s->active > 0) {
+    if (tscatwait(s) < 0)
+      return -1;
+
+    in->ready = 0;
+
+    if (getnline_read(&in->r) < 0)
+      return -1;
+
+    for (;;) {
+      if (!magic) {
+        n = getnbytes(&in->r, &buf, TSBIN_MAGICLEN);
+        if (n == 0)
+          break;
+        if (n != TSBIN_MAGICLEN || memcmp(buf, TSBIN_MAGIC, n) != 0)
+          goto ERR_BADMSG;
+        magic = 1;
+      }
+
+      if (!hdr) {
+        n = getnbytes(&in->r, &buf, TSBIN_HDRLEN);
+        if (n == 0)
+          break;
+        if (n != TSBIN_HDRLEN)
+          goto ERR_BADMSG;
+        tsbin_decode(buf, &h);
+        /* records are written in chunks: s->obuf holds a chunk */
+        if (h.len > in->r.size ||
+            (!(h.flags & TSBIN_LABEL) && h.len > TS_CHUNK))
+          goto ERR_BADMSG;
+        hdr = 1;
+      }
+
+      n = 0;
+      if (h.len > 0) {
+        n = getnbytes(&in->r, &buf, h.len);
+        if (n == 0)
+          break;
+        if (n != h.len)
+          goto ERR_BADMSG;
+      }
+
+      hdr = 0;
+
+      if (h.flags & TSBIN_LABEL) {
+        if (tscatlabel(s, h.id, buf, n) < 0)
+          return -1;
+        continue;
+      }
+
+      if (h.id >= s->nlabel)
+        goto ERR_BADMSG;
+
+      tsbin_timespec(h.ts, &now);
+
+      if (first) {
+        s->start = now;
+        s->prev = now;
+        first = 0;
+      }
+
+      s->labels[h.id].print_timestamp = !(h.flags & TSBIN_CONT);
+
+      if (tscatout(s, &s->labels[h.id], &now, buf, n) < 0)
+        return -1;
+    }
+
+    if (in->r.eof) {
+      if (hdr)
+        goto ERR_BADMSG;
+      s->active--;
+    }
+  }
+
+  if (tscatflush(s) < 0 || tscatdrain(s) < 0)
+    return -1;
+
+  getnline_free(&in->r);
+  return 0;
+
+ERR_BADMSG:
+  errno = EBADMSG;
+  return -1;
+}
+
+/* decode: define the label for an id */
+static int tscatlabel(ts_state_t *s, int id, const char *buf, size_t n) {
+  ts_input_t *in;
+
+  if (id >= s->nlabel) {
+    in = realloc(s->labels, (id + 1) * sizeof(ts_input_t));
+    if (in == NULL)
+      return -1;
+
+    s->labels = in;
+    (void)memset(&s->labels[s->nlabel], 0,
+                 (id + 1 - s->nlabel) * sizeof(ts_input_t));
+    s->nlabel = id + 1;
+  }
+
+  in = &s->labels[id];
+  free(in->label);
+
+  /* label, separator */
+  in->labellen = n == 0 ? 0 : n + 1;
+  in->label = malloc(in->labellen + 1);
+  if (in->label == NULL)
+    return -1;
+
+  (void)memcpy(in->label, buf, n);
+  if (n > 0)
+    in->label[n] = ' ';
+  in->label[in->labellen] = '\0';
+
+  in->print_timestamp = 1;
+
+  /* the encoded label is written to s->obuf */
+  return tscatobuf(s);
+}
+
+/* Maximum length of the next record.
+ *
+ * split, truncate: records do not cross the max-line boundary of the
+ * current line
+ */
+static size_t tscatnmax(ts_state_t *s, ts_input_t *in) {
+  size_t n = TS_CHUNK;
+
+  if (s->long_line == TS_LONG_STREAM || s->max_line == 0)
+    return n;
+
+  if (in->linelen == s->max_line)
+    return s->long_line == TS_LONG_SPLIT && s->max_line < n ? s->max_line
+                                                            : n;
+
+  return s->max_line - in->linelen < n ? s->max_line - in->linelen : n;
+}
+
+/* Apply the long line behaviour to a record.
+ *
+ * stream: records are written as they are read. A line longer than a
+ *         record is written as continuations of the first record.
+ * split: a line reaching max-line bytes is terminated with a newline,
+ *        unless the next byte is the newline. The remainder is written
+ *        as a new line.
+ * truncate: the remainder of a line reaching max-line bytes is
+ *           discarded up to the newline.
+ *
+ * Memory use does not depend on the length of the line: in->linelen is
+ * the number of bytes of the current line written so far.
+ */
+static int tscatline(ts_state_t *s, ts_input_t *in, const struct timespec *now,
+                     char *buf, size_t n) {
+  char nl = s->delim;
+  int eol = (buf[n - 1] == s->delim);
+
+  if (s->long_line == TS_LONG_STREAM || s->max_line == 0)
+    return tscatrecord(s, in, now, buf, n);
+
+  if (in->linelen == s->max_line) {
+    switch (s->long_line) {
+    case TS_LONG_SPLIT:
+      in->linelen = 0;
+      if (buf[0] == s->delim)
+        return tscatrecord(s, in, now, buf, n);
+      if (tscatrecord(s, in, now, &nl, 1) < 0)
+        return -1;
+      break;
+    case TS_LONG_TRUNCATE:
+      if (!eol)
+        return 0;
+      in->linelen = 0;
+      return tscatrecord(s, in, now, &nl, 1);
+    }
+  }
+
+  in->linelen = eol ? 0 : in->linelen + n;
+
+  return tscatrecord(s, in, now, buf, n);
+}
+
+static int tscatrecord(ts_state_t *s, ts_input_t *in,
+                       const struct timespec *now, char *buf, size_t n) {
+  in->midline = (buf[n - 1] != s->delim);
+
+  if (s->threads)
+    return tsring_put(&s->ring, now, in - s->in, buf, n);
+
+  return tscatout(s, in, NULL, buf, n);
+}
+
+/* now: the time the record was read or NULL to use the current time */
+static int tscatout(ts_state_t *s, ts_input_t *in, const struct timespec *now,
+                    char *buf, size_t n) {
+  struct timespec ts;
+  struct timespec end;
+  struct timespec elapsed;
+  struct iovec iov[3];
+  int iovcnt = 0;
+  size_t len = 0;
+  int nl;
+  int i;
+
+  if (n == 0)
+    return 0;
+
+  nl = (buf[n - 1] == s->delim);
+
+  /* json, logfmt: each record is written as a complete object */
+  if (s->output_format == TS_OUTPUT_JSON ||
+      s->output_format == TS_OUTPUT_LOGFMT)
+    in->print_timestamp = 1;
+
+  /* binary: every record is timestamped */
+  if (now == NULL && (in->print_timestamp || s->stats_fd != -1 ||
+                      s->output_format == TS_OUTPUT_BINARY)) {
+    if (clock_gettime(s->clock, &ts) < 0)
+      return -1;
+    now = &ts;
+  }
+
+  switch (s->output_format) {
+  case TS_OUTPUT_BINARY:
+    /* timestamps are formatted when decoded */
+    iov[iovcnt].iov_base = s->obuf;
+    iov[iovcnt].iov_len = tscatbinary(s, in, now, n);
+    iovcnt++;
+
+    iov[iovcnt].iov_base = buf;
+    iov[iovcnt].iov_len = n;
+    iovcnt++;
+    break;
+
+  case TS_OUTPUT_JSON:
+  case TS_OUTPUT_LOGFMT:
+    if (tscatprefix(s, tscatrelative(s, now, &elapsed)) < 0)
+      return -1;
+
+    iov[iovcnt].iov_base = s->obuf;
+    iov[iovcnt].iov_len = tscatencode(s, in, buf, n);
+    iovcnt++;
+    break;
+
+  default:
+    if (in->print_timestamp) {
+      if (tscatprefix(s, tscatrelative(s, now, &elapsed)) < 0)
+        return -1;
+
+      iov[iovcnt].iov_base = s->prefix;
+      iov[iovcnt].iov_len = s->prefixlen;
+      iovcnt++;
+
+      iov[iovcnt].iov_base = in->label;
+      iov[iovcnt].iov_len = in->labellen;
+      iovcnt++;
+    }
+
+    iov[iovcnt].iov_base = buf;
+    iov[iovcnt].iov_len = n;
+    iovcnt++;
+    break;
+  }
+
+  for (i = 0; i < iovcnt; i++)
+    len += iov[i].iov_len;
+
+  /* output-file: files are only rotated at the start of a line */
+  if (s->rotate.fd != -1 && in->print_timestamp && tscatrotate(s, len) < 0)
+    return -1;
+
+  /* A record discarded by one output is still written to the other
+   * outputs.
+   *
+   * io: the record is buffered and the lines for all outputs are written
+   * together
+   */
+  for (i = 0; i < s->nout; i++) {
+    if (tsout_write(&s->out[i], iov, iovcnt,
+                    s->out[i].flush == TS_FLUSH_LINE &&
+                        !tscaturingout(s, &s->out[i])) < 0 &&
+        (errno != EAGAIN || s->out[i].write_error != TS_WR_DROP))
+      return -1;
+  }
+
+  s->rotate.written += len;
+
+  if (s->io == TS_IO_URING && !s->udefer && tscaturingflush(s, 1) < 0)
+    return -1;
+
+  if (s->output_format == TS_OUTPUT_BINARY)
+    s->binhdr = 1;
+
+  /* stats: time from timestamping the record until the record has been
+   * written or buffered by all outputs
+   */
+  if (s->stats_fd != -1) {
+    if (clock_gettime(s->clock, &end) < 0)
+      return -1;
+
+    tsstats_latency(&s->stats, ((end.tv_sec - now->tv_sec) * 1000000000LL +
+                                (end.tv_nsec - now->tv_nsec)) /
+                                   1000);
+  }
+
+  in->print_timestamp = nl;
+
+  return 0;
+}
+
+/* json, logfmt: encode the timestamp, label and record into s->obuf,
+ * terminated by the delimiter. Any delimiter ending the record is not
+ * part of the message.
+ *
+ * json: {"ts":"<timestamp>","label":"<label>","msg":"<record>"}
+ * logfmt: ts=<timestamp> label=<label> msg=<record>
+ *
+ * The timestamp and label are omitted if empty.
+ */
+static size_t tscatencode(ts_state_t *s, ts_input_t *in, const char *buf,
+                          size_t n) {
+  int json = (s->output_format == TS_OUTPUT_JSON);
+  char sep = json ? ',' : ' ';
+  char *p = s->obuf;
+  int partial = 1;
+
+  if (buf[n - 1] == s->delim) {
+    n--;
+    partial = 0;
+  }
+
+  if (json)
+    *p++ = '{';
+
+  /* the prefix and label include a trailing space */
+  if (s->prefixlen > 0) {
+    p = tscatfield(s, p, "ts", s->prefix, s->prefixlen - 1);
+    *p++ = sep;
+  }
+
+  if (in->labellen > 0) {
+    p = tscatfield(s, p, "label", in->label, in->labellen - 1);
+    *p++ = sep;
+  }
+
+  p = tscatfield(s, p, "msg", buf, n);
+
+  /* A line longer than a record is split: the message of a partial
+   * record continues in the next record for the label.
+   */
+  if (partial) {
+    const char *field = json ? ",\"partial\":true" : " partial=true";
+    size_t len = strlen(field);
+
+    (void)memcpy(p, field, len);
+    p += len;
+  }
+
+  if (json)
+    *p++ = '}';
+
+  *p++ = s->delim;
+
+  return p - s->obuf;
+}
+
+/* binary: the record header in s->obuf. The first record is preceded by
+ * the magic and a label record for each input.
+ */
+static size_t tscatbinary(ts_state_t *s, ts_input_t *in,
+                          const struct timespec *now, size_t n) {
+  tsbin_hdr_t h = {0};
+  char *p = s->obuf;
+
+  if (!s->binhdr)
+    p += tscatlabels(s, p);
+
+  h.len = n;
+  h.id = in - s->in;
+  h.flags = in->print_timestamp ? 0 : TSBIN_CONT;
+  h.ts = tsbin_nsec(now);
+  tsbin_encode(p, &h);
+  p += TSBIN_HDRLEN;
+
+  return p - s->obuf;
+}
+
+/* binary: the magic followed by a label record for each input */
+static size_t tscatlabels(ts_state_t *s, char *p) {
+  tsbin_hdr_t h = {0};
+  size_t n = TSBIN_MAGICLEN;
+  int i;
+
+  (void)memcpy(p, TSBIN_MAGIC, TSBIN_MAGICLEN);
+
+  /* the label includes a trailing space */
+  for (i = 0; i < s->nin; i++) {
+    h.len = s->in[i].labellen > 0 ? s->in[i].labellen - 1 : 0;
+    h.id = i;
+    h.flags = TSBIN_LABEL;
+    tsbin_encode(p + n, &h);
+    (void)memcpy(p + n + TSBIN_HDRLEN, s->in[i].label, h.len);
+    n += TSBIN_HDRLEN + h.len;
+  }
+
+  return n;
+}
+
+/* output-file: rotate the file before writing a record of n bytes.
+ *
+ * Buffered records are written to the current file. In binary format,
+ * each file starts with the magic and labels so files can be decoded
+ * independently.
+ */
+static int tscatrotate(ts_state_t *s, size_t n) {
+  struct iovec iov;
+  tsout_t *o = NULL;
+  int i;
+
+  if (!tsrotate_due(&s->rotate, n))
+    return 0;
+
+  for (i = 0; i < s->nout; i++) {
+    if (s->out[i].fd == s->rotate.fd)
+      o = &s->out[i];
+  }
+
+  if (o == NULL)
+    return 0;
+
+  /* compress: each file is a complete gzip stream */
+  if (tsout_flush(o) < 0 || (o->z != NULL && tscompress_end(o->z) < 0) ||
+      tsrotate(&s->rotate) < 0)
+    return -1;
+
+  if (s->output_format != TS_OUTPUT_BINARY || !s->binhdr)
+    return 0;
+
+  /* s->obuf holds the record header: the labels are written after the
+   * header. The first record includes the labels.
+   */
+  iov.iov_base = s->obuf + TSBIN_HDRLEN;
+  iov.iov_len = tscatlabels(s, iov.iov_base);
+  s->rotate.written += iov.iov_len;
+
+  return tsout_write(o, &iov, 1, 0);
+}
+
+/* logfmt: values are quoted only if required */
+static char *tscatfield(ts_state_t *s, char *p, const char *key,
+                        const char *val, size_t len) {
+  int json = (s->output_format == TS_OUTPUT_JSON);
+  size_t n = strlen(key);
+
+  if (json)
+    *p++ = '"';
+
+  (void)memcpy(p, key, n);
+  p += n;
+
+  if (json) {
+    (void)memcpy(p, "\":", 2);
+    p += 2;
+  } else
+    *p++ = '=';
+
+  if (!json && tsescape_bare(val, len)) {
+    (void)memcpy(p, val, len);
+    return p + len;
+  }
+
+  *p++ = '"';
+  p += tsescape_json(p, val, len);
+  *p++ = '"';
+
+  return p;
+}
+
+/* relative: the time elapsed since the start or since the previous line
+ *
+ * A clock stepping backwards is treated as no time elapsed.
+ */
+static const struct timespec *tscatrelative(ts_state_t *s,
+                                            const struct timespec *now,
+                                            struct timespec *elapsed) {
+  const struct timespec *base;
+
+  if (s->relative == TS_RELATIVE_NONE)
+    return now;
+
+  base = s->relative == TS_RELATIVE_START ? &s->start : &s->prev;
+
+  tscatelapsed(base, now, elapsed);
+
+  if (s->relative == TS_RELATIVE_PREV)
+    s->prev = *now;
+
+  return elapsed;
+}
+
+static void tscatelapsed(const struct timespec *base,
+                         const struct timespec *now, struct timespec *elapsed) {
+  elapsed->tv_sec = now->tv_sec - base->tv_sec;
+  elapsed->tv_nsec = now->tv_nsec - base->tv_nsec;
+  if (elapsed->tv_nsec < 0) {
+    elapsed->tv_sec--;
+    elapsed->tv_nsec += 1000000000L;
+  }
+
+  if (elapsed->tv_sec < 0) {
+    elapsed->tv_sec = 0;
+    elapsed->tv_nsec = 0;
+  }
+}
+
+/* json, logfmt: the count of records dropped by an output is written as
+ * a record without a label:
+ *
+ * {"ts":"<timestamp>","msg":"tscat: dropped <n> lines (<m> bytes)",
+ *  "dropped":<n>,"dropped_bytes":<m>}
+ *
+ * Called when the output is flushed: the record being written may refer
+ * to s->obuf and s->prefix.
+ */
+static int tscatmarker(void *arg, char *buf, size_t size, size_t dropped,
+                       size_t droppedlen) {
+  ts_state_t *s = arg;
+  int json = (s->output_format == TS_OUTPUT_JSON);
+  char sep = json ? ',' : ' ';
+  struct timespec now;
+  struct timespec elapsed;
+  const struct timespec *t = &now;
+  struct tm tm;
+  char ts[sizeof(s->prefix)];
+  char msg[96];
+  size_t tslen;
+  char *p = buf;
+  int msglen;
+  int n;
+
+  if (size < TSESCAPE_MAX(sizeof(ts) + sizeof(msg)) + 128)
+    return -1;
+
+  if (clock_gettime(s->clock, &now) < 0)
+    return -1;
+
+  if (s->relative != TS_RELATIVE_NONE) {
+    tscatelapsed(s->relative == TS_RELATIVE_START ? &s->start : &s->prev,
+                 &now, &elapsed);
+    t = &elapsed;
+  }
+
+  if (tstime_localtime(&s->tz, t->tv_sec, &tm) == NULL)
+    return -1;
+
+  tslen = tsformat_render(&s->fmt, t, &tm, ts, sizeof(ts) - 1);
+
+  msglen = snprintf(msg, sizeof(msg), "tscat: dropped %zu lines (%zu bytes)",
+                    dropped, droppedlen);
+  if (msglen < 0 || (size_t)msglen >= sizeof(msg))
+    return -1;
+
+  if (json)
+    *p++ = '{';
+
+  if (tslen > 0) {
+    p = tscatfield(s, p, "ts", ts, tslen);
+    *p++ = sep;
+  }
+
+  p = tscatfield(s, p, "msg", msg, msglen);
+
+  n = snprintf(p, size - (p - buf),
+               json ? ",\"dropped\":%zu,\"dropped_bytes\":%zu}%c"
+                    : " dropped=%zu dropped_bytes=%zu%c",
+               dropped, droppedlen, s->delim);
+  if (n < 0 || (size_t)n >= size - (p - buf))
+    return -1;
+
+  return p - buf + n;
+}
+
+/* Without sub-second conversions, the rendered "timestamp " prefix is
+ * reused until the second changes.
+ */
+static int tscatprefix(ts_state_t *s, const struct timespec *now) {
+  size_t len;
+
+  if (!s->fmt.subsecond && now->tv_sec == s->prefixtime)
+    return 0;
+
+  if (now->tv_sec != s->tmtime) {
+    if (tstime_update(&s->tz, now->tv_sec) < 0 ||
+        tstime_localtime(&s->tz, now->tv_sec, &s->tm) == NULL)
+      return -1;
+    s->tmtime = now->tv_sec;
+  }
+
+  /* An empty result is either an empty format or a timestamp that does
+   * not fit: in both cases, the timestamp is omitted.
+   */
+  len = tsformat_render(&s->fmt, now, &s->tm, s->prefix,
+                        sizeof(s->prefix) - 1);
+  if (len > 0)
+    s->prefix[len++] = ' ';
+
+  s->prefixlen = len;
+  s->prefixtime = now->tv_sec;
+
+  return 0;
+}
+
+void *tscatwriter(void *arg) {
+  ts_state_t *s = arg;
+  struct timespec now;
+  char *buf;
+  ssize_t n;
+  int tag;
+  int timeout;
+  int blocked;
+
+  for (;;) {
+    timeout = tscattimeout(s);
+
+    if (timeout == 0 && s->flush == TS_FLUSH_INTERVAL) {
+      if (tscatflush(s) < 0)
+        err(EXIT_FAILURE, "tscatflush");
+      continue;
+    }
+
+    /* queue: records are queued while waiting for a blocked output */
+    blocked = tscatblocked(s);
+
+    n = tsring_get(&s->ring, &now, &tag, &buf, blocked ? 0 : timeout);
+
+    if (n == 0)
+      break;
+
+    if (n == -1) {
+      if (blocked && timeout != 0) {
+        if (timeout == -1 || timeout > TS_QUEUE_POLL_INTERVAL)
+          timeout = TS_QUEUE_POLL_INTERVAL;
+        if (tscatpoll(s, 0, timeout) < 0)
+          err(EXIT_FAILURE, "tscatpoll");
+        continue;
+      }
+      if (tscatflush(s) < 0)
+        err(EXIT_FAILURE, "tscatflush");
+      continue;
+    }
+
+    /* queue: a blocked output is written as it becomes writable, not
+     * only once the ring is empty
+     */
+    if (blocked && tscatpoll(s, 0, 0) < 0)
+      err(EXIT_FAILURE, "tscatpoll");
+
+    if (tscatout(s, &s->in[tag], &now, buf, n) < 0)
+      err(EXIT_FAILURE, "tscatout");
+
+    tsring_pop(&s->ring);
+  }
+
+  if (tscatflush(s) < 0 || tscatdrain(s) < 0)
+    err(EXIT_FAILURE, "tscatflush");
+
+  return NULL;
+}
+
+/* Milliseconds until buffered output must be flushed.
+ *
+ * batch: output is flushed when no input is available
+ * interval: output is flushed when the oldest buffered record has waited
+ *           for the interval
+ *
+ * Returns -1 if there is no buffered output. Output queued for a blocked
+ * output is written when the output is writable.
+ */
+static int tscattimeout(ts_state_t *s) {
+  long long now;
+  int pending = 0;
+  int i;
+
+  for (i = 0; i < s->nout; i++) {
+    if (s->out[i].len > 0 && !s->out[i].blocked &&
+        s->out[i].flush != TS_FLUSH_LINE)
+      pending = 1;
+  }
+
+  if (!pending) {
+    s->flush_deadline = 0;
+    return -1;
+  }
+
+  if (s->flush != TS_FLUSH_INTERVAL)
+    return 0;
+
+  now = tscatmsec();
+  if (s->flush_deadline == 0)
+    s->flush_deadline = now + s->flush_interval;
+
+  return s->flush_deadline > now ? s->flush_deadline - now : 0;
+}
+
+/* Flush buffered output before waiting for input.
+ *
+ * queue: while waiting, queued output is written as the output becomes
+ * writable.
+ */
+static int tscatwait(ts_state_t *s) {
+  int timeout;
+  int held;
+  int limited;
+  int rv;
+
+  for (;;) {
+    held = tscatheld(s);
+    if (held == 0)
+      return tscatrelease(s);
+
+    limited = tscatlimited(s);
+    if (limited == 0)
+      return tscatreport(s);
+
+    timeout = tscattimeout(s);
+    if (timeout == -1 && !tscatblocked(s))
+      return tscatready(s);
+
+    if (held != -1 && (timeout == -1 || held < timeout))
+      timeout = held;
+
+    if (limited != -1 && (timeout == -1 || limited < timeout))
+      timeout = limited;
+
+    if (timeout == 0 && s->flush == TS_FLUSH_INTERVAL) {
+      if (tscatflush(s) < 0)
+        return -1;
+      if (!tscatblocked(s))
+        return tscatready(s);
+      continue;
+    }
+
+    rv = tscatpoll(s, 1, timeout);
+    switch (rv) {
+    case -1:
+      return -1;
+    case 0:
+      if (tscatflush(s) < 0)
+        return -1;
+      if (!tscatblocked(s))
+        return tscatready(s);
+      break;
+    case 1:
+      return 0;
+    default:
+      break;
+    }
+  }
+}
+
+/* Wait for input. A single input is read without polling: the read
+ * waits for input.
+ *
+ * threads: called by the reader thread, the outputs are not polled
+ */
+static int tscatready(ts_state_t *s) {
+  int timeout;
+  int limited;
+  int rv;
+
+  timeout = tscatheld(s);
+  if (timeout == 0)
+    return tscatrelease(s);
+
+  limited = tscatlimited(s);
+  if (limited == 0)
+    return tscatreport(s);
+
+  if (limited != -1 && (timeout == -1 || limited < timeout))
+    timeout = limited;
+
+  if (s->nin == 1 && timeout == -1) {
+    s->in[0].ready = 1;
+    return 0;
+  }
+
+  tscatpollin(s);
+
+  do {
+    rv = poll(s->fds, s->nin, timeout);
+  } while (rv == -1 && errno == EINTR);
+
+  if (rv < 0)
+    return -1;
+
+  /* timeout: the line is released or the count written by the next call */
+  if (rv == 0)
+    return 0;
+
+  (void)tscatrevents(s);
+
+  return 0;
+}
+
+/* While a line is being written, only the input writing the line is
+ * polled. poll(2) ignores negative descriptors.
+ */
+static void tscatpollin(ts_state_t *s) {
+  int i;
+
+  for (i = 0; i < s->nin; i++) {
+    ts_input_t *in = &s->in[i];
+
+    s->fds[i].fd = in->r.eof || (s->owner != NULL && s->owner != in)
+                       ? -1
+                       : in->fd;
+    s->fds[i].events = POLLIN;
+    s->fds[i].revents = 0;
+  }
+}
+
+/* Returns the milliseconds until the line held by an input is released
+ * or -1 if no line is held. A single input holds the line until the line
+ * ends.
+ */
+static int tscatheld(ts_state_t *s) {
+  long long now;
+
+  if (s->owner == NULL || s->nin == 1)
+    return -1;
+
+  now = tscatmsec();
+
+  return s->owner_deadline > now ? s->owner_deadline - now : 0;
+}
+
+/* Terminate the line held by an input: the other inputs are read and the
+ * rest of the line is written as a new line.
+ */
+static int tscatrelease(ts_state_t *s) {
+  struct timespec now;
+  ts_input_t *in = s->owner;
+  char nl = s->delim;
+
+  if (s->threads && clock_gettime(s->clock, &now) < 0)
+    return -1;
+
+  s->owner = NULL;
+  in->linelen = 0;
+
+  return tscatrecord(s, in, &now, &nl, 1);
+}
+
+/* rate: returns the milliseconds until the count of suppressed lines is
+ * written or -1 if no lines are suppressed. The count is not written in
+ * the middle of a line.
+ */
+static int tscatlimited(ts_state_t *s) {
+  struct timespec mono;
+  long long ms;
+
+  if (s->rate.suppressed == 0 || s->owner != NULL)
+    return -1;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &mono) < 0)
+    return 0;
+
+  ms = 1000 - tsrate_elapsed(&s->rate, &mono);
+
+  return ms > 0 ? ms : 0;
+}
+
+/* rate: write the count of suppressed lines when no line has been read
+ * for the rest of the second
+ */
+static int tscatreport(ts_state_t *s) {
+  struct timespec now;
+  struct timespec mono;
+
+  if ((s->threads && clock_gettime(s->clock, &now) < 0) ||
+      clock_gettime(CLOCK_MONOTONIC, &mono) < 0)
+    return -1;
+
+  return tscatsuppressed(s, s->limited, &now, &mono);
+}
+
+/* Returns 1 if any input is readable. */
+static int tscatrevents(ts_state_t *s) {
+  int ready = 0;
+  int i;
+
+  for (i = 0; i < s->nin; i++) {
+    if (s->fds[i].revents == 0)
+      continue;
+
+    /* POLLERR and POLLHUP are reported by the read */
+    s->in[i].ready = 1;
+    ready = 1;
+  }
+
+  return ready;
+}
+
+/* Wait for input or for a blocked output to become writable.
+ *
+ * input: 1 to wait for input or 0 to wait for output only
+ *
+ * Queued output is written to any output that is writable, including
+ * when input is available. Returns 1 if input is available, 2 if output
+ * was written and 0 on timeout.
+ */
+static int tscatpoll(ts_state_t *s, int input, int timeout) {
+  struct pollfd *fds = s->fds + s->nin;
+  int rv;
+  int i;
+
+  /* poll(2) ignores negative descriptors */
+  for (i = 0; i < s->nout; i++) {
+    fds[i].fd = s->out[i].blocked ? s->out[i].fd : -1;
+    fds[i].events = POLLOUT;
+    fds[i].revents = 0;
+  }
+
+  if (input)
+    tscatpollin(s);
+
+  do {
+    rv = input ? poll(s->fds, s->nin + s->nout, timeout)
+               : poll(fds, s->nout, timeout);
+  } while (rv == -1 && errno == EINTR);
+
+  if (rv <= 0)
+    return rv;
+
+  for (i = 0; i < s->nout; i++) {
+    if (fds[i].revents == 0)
+      continue;
+
+    /* POLLERR and POLLHUP are reported by the write */
+    if (tsout_flush(&s->out[i]) < 0 && errno != EAGAIN)
+      return -1;
+  }
+
+  return input && tscatrevents(s) ? 1 : 2;
+}
+
+/* queue: wait for queued output to be written
+ *
+ * compress: wait for the compressed output to be written
+ */
+static int tscatdrain(ts_state_t *s) {
+  int i;
+
+  while (tscatblocked(s)) {
+    if (tscatpoll(s, 0, -1) < 0)
+      return -1;
+  }
+
+  for (i = 0; i < s->nout; i++) {
+    if (s->out[i].z == NULL)
+      continue;
+
+    if (tscompress_close(s->out[i].z) < 0)
+      return -1;
+
+    free(s->out[i].z);
+    s->out[i].z = NULL;
+  }
+
+  return 0;
+}
+
+static int tscatblocked(ts_state_t *s) {
+  int i;
+
+  for (i = 0; i < s->nout; i++) {
+    if (s->out[i].blocked)
+      return 1;
+  }
+
+  return 0;
+}
+
+static int tscatflush(ts_state_t *s) {
+  int i;
+
+  s->flush_deadline = 0;
+
+  if (s->io == TS_IO_URING)
+    return tscaturingflush(s, 0);
+
+  for (i = 0; i < s->nout; i++) {
+    if (tscatflushout(&s->out[i]) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int tscatflushout(tsout_t *o) {
+  if (tsout_flush(o) < 0) {
+    if (errno == EAGAIN &&
+        (o->write_error == TS_WR_DROP || o->write_error == TS_WR_QUEUE))
+      return 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* io: a ring with a request for each output and the input read */
+int tscaturinginit(ts_state_t *s) {
+  s->uiov = calloc(s->nout * 2, sizeof(struct iovec));
+  if (s->uiov == NULL)
+    return -1;
+
+  if (tsuring_init(&s->uring, s->nout + 1) < 0) {
+    free(s->uiov);
+    s->uiov = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* io: outputs written using io_uring
+ *
+ * Duplicated and compressed outputs are written by tsout. Outputs
+ * discarding or queueing records when blocked write each line
+ * immediately.
+ */
+static int tscaturingout(ts_state_t *s, const tsout_t *o) {
+  return s->io == TS_IO_URING && o->dup == -1 && o->z == NULL &&
+         o->write_error != TS_WR_DROP && o->write_error != TS_WR_QUEUE;
+}
+
+/* io: read a single input using io_uring
+ *
+ * The read is submitted with the writes for the records of the previous
+ * read. If the read does not complete immediately, the input is idle:
+ * batched output is flushed while waiting.
+ */
+static int tscaturingin(ts_state_t *s) {
+  ts_input_t *in = &s->in[0];
+  char *buf;
+  ssize_t n;
+
+  s->udefer = 1;
+
+  while (s->active > 0) {
+    /* queue: a blocked output is polled while waiting for input */
+    if (tscatblocked(s)) {
+      if (tscatwait(s) < 0 || tscatread(s, in) < 0)
+        return -1;
+      continue;
+    }
+
+    n = getnline_space(&in->r, &buf);
+    if (n < 0)
+      return -1;
+
+    if (tsuring_read(&s->uring, in->fd, buf, n, TS_URING_READ) < 0)
+      return -1;
+
+    s->uread = 1;
+
+    if (tscaturingflush(s, 1) < 0)
+      return -1;
+
+    if (s->uread && tscattimeout(s) == 0 && tscaturingflush(s, 0) < 0)
+      return -1;
+
+    if (tscaturingwait(s, 0, 1) < 0)
+      return -1;
+
+    if (s->uresult < 0) {
+      errno = -s->uresult;
+      return -1;
+    }
+
+    getnline_commit(&in->r, s->uresult);
+
+    if (tscatrecords(s, in) < 0)
+      return -1;
+  }
+
+  s->udefer = 0;
+
+  if (tscatflush(s) < 0 || tscatdrain(s) < 0)
+    return -1;
+
+  tsuring_free(&s->uring);
+  free(s->uiov);
+  getnline_free(&in->r);
+
+  return 0;
+}
+
+/* io: write the buffered output in one submission
+ *
+ * line: only outputs flushed after every line
+ */
+static int tscaturingflush(ts_state_t *s, int line) {
+  unsigned n = 0;
+  int iovcnt;
+  int i;
+
+  for (i = 0; i < s->nout; i++) {
+    tsout_t *o = &s->out[i];
+
+    if (line && o->flush != TS_FLUSH_LINE)
+      continue;
+
+    if (!tscaturingout(s, o)) {
+      if (tscatflushout(o) < 0)
+        return -1;
+      continue;
+    }
+
+    iovcnt = tsout_pending(o, &s->uiov[i * 2]);
+    if (iovcnt == 0)
+      continue;
+
+    if (tsuring_writev(&s->uring, o->fd, &s->uiov[i * 2], iovcnt, i) < 0)
+      return -1;
+
+    n++;
+  }
+
+  return tscaturingwait(s, n, 0);
+}
+
+/* io: submit the queued requests and wait for n writes and, if read is
+ * set, the input read to complete
+ *
+ * The remainder of a partial write is written by tsout. A failed write is
+ * retried by tsout: the error is handled by the output write policy.
+ */
+static int tscaturingwait(ts_state_t *s, unsigned n, int read) {
+  uint64_t data;
+  int res;
+
+  for (;;) {
+    if (tsuring_enter(&s->uring, n + (read && s->uread)) < 0)
+      return -1;
+
+    while (tsuring_reap(&s->uring, &data, &res)) {
+      tsout_t *o;
+
+      if (data == TS_URING_READ) {
+        s->uread = 0;
+        s->uresult = res;
+        continue;
+      }
+
+      n--;
+      o = &s->out[data];
+
+      if (res < 0)
+        errno = -res;
+
+      if ((tsout_written(o, res < 0 ? -1 : res) < 0 || o->len > 0) &&
+          tscatflushout(o) < 0)
+        return -1;
+    }
+
+    if (n == 0 && !(read && s->uread))
+      return 0;
+  }
+}
+
+long long tscatmsec(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    return 0;
+
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef LIBTSCAT_H
+#define LIBTSCAT_H
+
+#include <stddef.h>
+
+/* libtscat: timestamp the output of a process without a pipe to a
+ * separate tscat process.
+ *
+ * A stream reads records from buffers written by the caller and writes
+ * the timestamped records to its sinks: the output is the same as tscat
+ * reading the records from stdin. A stream is not thread safe.
+ *
+ *   tscat_t *t = tscat_open(NULL, "app");
+ *
+ *   (void)tscat_sink(t, STDOUT_FILENO, NULL);
+ *   (void)tscat_write(t, "started\n", 8);
+ *   (void)tscat_close(t);
+ */
+typedef struct tscat tscat_t;
+
+/* The library is built with hidden visibility: only the tscat_
+ * functions are exported.
+ */
+#if defined(__GNUC__)
+#define TSCAT_API __attribute__((visibility("default")))
+#else
+#define TSCAT_API
+#endif
+
+typedef struct {
+  unsigned long long lines;
+  unsigned long long bytes;
+  unsigned long long dropped;
+  unsigned long long dropped_bytes;
+} tscat_stats_t;
+
+TSCAT_API tscat_t *tscat_open(const char *format, const char *label);
+TSCAT_API int tscat_sink(tscat_t *t, int fd, const char *write_error);
+TSCAT_API int tscat_write(tscat_t *t, const char *buf, size_t n);
+TSCAT_API int tscat_flush(tscat_t *t);
+TSCAT_API void tscat_stats(tscat_t *t, tscat_stats_t *st);
+TSCAT_API int tscat_close(tscat_t *t);
+
+#endif /* LIBTSCAT_H */
@@ -13,5 +13,29 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
-int restrict_process_init(void);
-int restrict_process_stdin(void);
+/* A directory in which files are created and renamed after the process
+ * is restricted. Files are opened on the spare descriptor number with the
+ * open(2) flags and moved to another descriptor using dup2(2).
+ */
+typedef struct {
+  const char *path;
+  int fd;
+  int spare;
+  int flags;
+} restrict_process_dir_t;
+
+/* Files opened after restrict_process_init():
+ *
+ * RESTRICT_PROCESS_FIFO: FIFO inputs are opened for reading and writing
+ * RESTRICT_PROCESS_FILE: output files are created in a directory
+ */
+enum { RESTRICT_PROCESS_FIFO = 1, RESTRICT_PROCESS_FILE = 2 };
+
+/* May be called again with fewer flags. */
+int restrict_process_init(int flags);
+/* Confine files created after the process is restricted to the directory.
+ * Called once the output file is opened and before any thread is started.
+ */
+int restrict_process_dir(const restrict_process_dir_t *dir);
+int restrict_process_stdin(const int *fd, int nfd,
+                           const restrict_process_dir_t *dir);
@@ -24,29 +24,60 @@
 
 #include <errno.h>
 
-int restrict_process_init(void) {
+static int restrict_process_output(int n, const int *fd, int nfd);
+
+int restrict_process_init(int flags) {
+  struct rlimit rl = {0};
+
+  (void)flags;
+
+  return setrlimit(RLIMIT_NPROC, &rl);
+}
+
+int restrict_process_dir(const restrict_process_dir_t *dir) {
+  (void)dir;
+  return 0;
+}
+
+/* fd: descriptors used after the restrictions are applied */
+int restrict_process_stdin(const int *fd, int nfd,
+                           const restrict_process_dir_t *dir) {
   struct rlimit rl = {0};
+  cap_rights_t policy_read;
+  cap_rights_t policy_write;
+  cap_rights_t policy_dir;
   struct stat sb;
+  int maxfd = STDERR_FILENO;
+  int i;
 
-  if (fstat(STDOUT_FILENO, &sb) < 0)
-    return -1;
+  /* Writes to regular files are limited by RLIMIT_FSIZE. */
+  for (i = 0; i < nfd; i++) {
+    if (fstat(fd[i], &sb) < 0)
+      return -1;
 
-  if (!S_ISREG(sb.st_mode)) {
+    if (S_ISREG(sb.st_mode))
+      break;
+  }
+
+  if (i == nfd) {
     if (setrlimit(RLIMIT_FSIZE, &rl) < 0)
       return -1;
   }
 
-  return setrlimit(RLIMIT_NPROC, &rl);
-}
+  for (i = 0; i < nfd; i++) {
+    if (fd[i] > maxfd)
+      maxfd = fd[i];
+  }
 
-int restrict_process_stdin(void) {
-  cap_rights_t policy_read;
-  cap_rights_t policy_write;
+  for (i = STDERR_FILENO + 1; i < maxfd; i++) {
+    if (!restrict_process_output(i, fd, nfd))
+      (void)close(i);
+  }
 
-  closefrom(STDERR_FILENO + 1);
+  closefrom(maxfd + 1);
 
   (void)cap_rights_init(&policy_read, CAP_READ, CAP_EVENT);
-  (void)cap_rights_init(&policy_write, CAP_WRITE, CAP_READ);
+  (void)cap_rights_init(&policy_write, CAP_WRITE, CAP_READ, CAP_EVENT);
 
   if (cap_rights_limit(STDIN_FILENO, &policy_read) < 0)
     return -1;
@@ -57,6 +88,37 @@ int restrict_process_stdin(void) {
   if (cap_rights_limit(STDERR_FILENO, &policy_write) < 0)
     return -1;
 
+  for (i = 0; i < nfd; i++) {
+    if (fd[i] <= STDERR_FILENO || (dir != NULL && fd[i] == dir->fd))
+      continue;
+
+    if (cap_rights_limit(fd[i], &policy_write) < 0)
+      return -1;
+  }
+
+  /* rotation: files opened relative to the directory inherit the rights
+   * of the directory
+   */
+  if (dir != NULL) {
+    (void)cap_rights_init(&policy_dir, CAP_LOOKUP, CAP_CREATE, CAP_WRITE,
+                          CAP_READ, CAP_EVENT, CAP_FSTAT, CAP_FTRUNCATE,
+                          CAP_RENAMEAT_SOURCE, CAP_RENAMEAT_TARGET);
+
+    if (cap_rights_limit(dir->fd, &policy_dir) < 0)
+      return -1;
+  }
+
   return cap_enter();
 }
+
+static int restrict_process_output(int n, const int *fd, int nfd) {
+  int i;
+
+  for (i = 0; i < nfd; i++) {
+    if (fd[i] == n)
+      return 1;
+  }
+
+  return 0;
+}
 #endif
@@ -14,7 +14,21 @@
  */
 #include "restrict_process.h"
 #ifdef RESTRICT_PROCESS_null
-int restrict_process_init(void) { return 0; }
+int restrict_process_init(int flags) {
+  (void)flags;
+  return 0;
+}
 
-int restrict_process_stdin(void) { return 0; }
+int restrict_process_dir(const restrict_process_dir_t *dir) {
+  (void)dir;
+  return 0;
+}
+
+int restrict_process_stdin(const int *fd, int nfd,
+                           const restrict_process_dir_t *dir) {
+  (void)fd;
+  (void)nfd;
+  (void)dir;
+  return 0;
+}
 #endif
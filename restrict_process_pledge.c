@@ -16,7 +16,37 @@
 #ifdef RESTRICT_PROCESS_pledge
 #include <unistd.h>
 
-int restrict_process_init(void) { return pledge("stdio rpath", NULL); }
+/* wpath: FIFO inputs are opened for reading and writing
+ * wpath, cpath, unveil: output files are created and restricted to a
+ * directory
+ */
+int restrict_process_init(int flags) {
+  if (flags & RESTRICT_PROCESS_FILE)
+    return pledge("stdio rpath wpath cpath unveil", NULL);
+
+  if (flags & RESTRICT_PROCESS_FIFO)
+    return pledge("stdio rpath wpath", NULL);
+
+  return pledge("stdio rpath", NULL);
+}
+
+int restrict_process_dir(const restrict_process_dir_t *dir) {
+  (void)dir;
+  return 0;
+}
+
+int restrict_process_stdin(const int *fd, int nfd,
+                           const restrict_process_dir_t *dir) {
+  (void)fd;
+  (void)nfd;
+
+  if (dir == NULL)
+    return pledge("stdio", NULL);
+
+  /* rotation: files are created and renamed only in the directory */
+  if (unveil(dir->path, "rwc") < 0 || unveil(NULL, NULL) < 0)
+    return -1;
 
-int restrict_process_stdin(void) { return pledge("stdio", NULL); }
+  return pledge("stdio rpath wpath cpath", NULL);
+}
 #endif
@@ -18,26 +18,73 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <unistd.h>
 
-int restrict_process_init(void) {
+int restrict_process_init(int flags) {
+  (void)flags;
+  return 0;
+}
+
+int restrict_process_dir(const restrict_process_dir_t *dir) {
+  (void)dir;
+  return 0;
+}
+
+/* Linux: RLIMIT_NPROC includes threads. The process limit is set after
+ * the writer thread has started.
+ *
+ * fd: descriptors used after the restrictions are applied
+ */
+int restrict_process_stdin(const int *fd, int nfd,
+                           const restrict_process_dir_t *dir) {
   struct rlimit rl_zero = {0};
+  struct rlimit rl_nofile = {0};
   struct stat sb;
+  int flags;
+  int i;
 
-  if (fstat(STDOUT_FILENO, &sb) < 0)
-    return -1;
+  /* Writes to regular files are limited by RLIMIT_FSIZE: the limit is not
+   * set if an output (stdout, a sink, the output file or the stats) is a
+   * regular file. Inputs are opened read only.
+   */
+  for (i = 0; i < nfd; i++) {
+    if (fstat(fd[i], &sb) < 0)
+      return -1;
+
+    if (!S_ISREG(sb.st_mode))
+      continue;
 
-  if (!S_ISREG(sb.st_mode)) {
+    flags = fcntl(fd[i], F_GETFL);
+    if (flags < 0)
+      return -1;
+
+    if ((flags & O_ACCMODE) != O_RDONLY)
+      break;
+  }
+
+  if (i == nfd) {
     if (setrlimit(RLIMIT_FSIZE, &rl_zero) < 0)
       return -1;
   }
 
-  return setrlimit(RLIMIT_NPROC, &rl_zero);
-}
+  if (setrlimit(RLIMIT_NPROC, &rl_zero) < 0)
+    return -1;
 
-int restrict_process_stdin(void) {
-  struct rlimit rl_zero = {0};
+  /* poll(2) fails with EINVAL if the number of descriptors exceeds
+   * RLIMIT_NOFILE: the limit is the number of descriptors in use (0 would
+   * fail polling stdin). The lowest descriptors are in use and no
+   * descriptor can be opened.
+   */
+  rl_nofile.rlim_cur = nfd;
+  rl_nofile.rlim_max = nfd;
+
+  /* rotation: the next file is opened on the spare descriptor */
+  if (dir != NULL && (rlim_t)dir->spare >= rl_nofile.rlim_cur) {
+    rl_nofile.rlim_cur = dir->spare + 1;
+    rl_nofile.rlim_max = dir->spare + 1;
+  }
 
-  return setrlimit(RLIMIT_NOFILE, &rl_zero);
+  return setrlimit(RLIMIT_NOFILE, &rl_nofile);
 }
 #endif
@@ -15,19 +15,38 @@
 #include "restrict_process.h"
 #ifdef RESTRICT_PROCESS_seccomp
 #include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <sys/prctl.h>
 #include <sys/syscall.h>
+#include <unistd.h>
 
 #include <linux/audit.h>
 #include <linux/filter.h>
+#include <linux/sched.h>
 #include <linux/seccomp.h>
 
+/* rotation: files in the directory are confined using landlock(7) */
+#if defined(__has_include)
+#if __has_include(<linux/landlock.h>)
+#include <linux/landlock.h>
+#endif
+#endif
+
+#if defined(LANDLOCK_CREATE_RULESET_VERSION) &&                               \
+    defined(__NR_landlock_create_ruleset) &&                                   \
+    defined(__NR_landlock_add_rule) && defined(__NR_landlock_restrict_self)
+#define RESTRICT_PROCESS_LANDLOCK
+#endif
+
 /* macros from openssh-7.2/restrict_process-seccomp-filter.c */
 
 /* Linux seccomp_filter restrict_process */
 #define SECCOMP_FILTER_FAIL SECCOMP_RET_KILL
 
+/* restrict_process_init() was applied */
+static int restrict_process_filtered;
+
 /* Use a signal handler to emit violations when debugging */
 #ifdef RESTRICT_PROCESS_SECCOMP_FILTER_DEBUG
 #undef SECCOMP_FILTER_FAIL
@@ -51,6 +70,56 @@
                                                        all rules expect it in  \
                                                        accumulator */          \
       BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr))
+#define SC_ALLOW_ARG_MASK(_nr, _arg_nr, _arg_mask)                             \
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, __NR_##_nr, 0, 4)                        \
+  , BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                         \
+             offsetof(struct seccomp_data, args[(_arg_nr)])),                  \
+      BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, (_arg_mask), 0, 1),                 \
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),                            \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr))
+
+/* rotation: the rules match only if a directory is used. Otherwise the
+ * syscall number is replaced by an invalid syscall number.
+ */
+#define SC_DIR_NR(_nr) (dir == NULL ? (unsigned int)-1 : __NR_##_nr)
+#define SC_DIR_ALLOW(_nr)                                                      \
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SC_DIR_NR(_nr), 0, 1)                    \
+  , BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
+#define SC_DIR_ALLOW_ARG(_nr, _arg_nr, _arg_val)                               \
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SC_DIR_NR(_nr), 0, 4)                    \
+  , BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                         \
+             offsetof(struct seccomp_data, args[(_arg_nr)])),                  \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (_arg_val), 0, 1),                   \
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),                            \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr))
+/* openat: the directory and the flags must match. The C library may add
+ * O_LARGEFILE.
+ */
+#ifndef O_LARGEFILE
+#define O_LARGEFILE 0
+#endif
+#define SC_DIR_ALLOW_OPENAT(_dirfd, _flags)                                    \
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SC_DIR_NR(openat), 0, 7)                 \
+  , BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                         \
+             offsetof(struct seccomp_data, args[0])),                          \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (_dirfd), 0, 4),                     \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                       \
+               offsetof(struct seccomp_data, args[2])),                        \
+      BPF_STMT(BPF_ALU + BPF_AND + BPF_K, ~(unsigned int)O_LARGEFILE),         \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (_flags), 0, 1),                     \
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),                            \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr))
+/* both arguments must match */
+#define SC_DIR_ALLOW_ARG2(_nr, _arg_nr1, _arg_nr2, _arg_val)                   \
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SC_DIR_NR(_nr), 0, 6)                    \
+  , BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                         \
+             offsetof(struct seccomp_data, args[(_arg_nr1)])),                 \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (_arg_val), 0, 3),                   \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS,                                       \
+               offsetof(struct seccomp_data, args[(_arg_nr2)])),               \
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (_arg_val), 0, 1),                   \
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),                            \
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr))
 
 /*
  * http://outflux.net/teach-seccomp/
@@ -73,7 +142,7 @@
 #define SECCOMP_AUDIT_ARCH 0
 #endif
 
-int restrict_process_init(void) {
+int restrict_process_init(int flags) {
   struct sock_filter filter[] = {
       /* Ensure the syscall arch convention is as expected. */
       BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, arch)),
@@ -83,6 +152,9 @@ int restrict_process_init(void) {
       BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),
 
 /* Syscalls to non-fatally deny */
+#ifdef __NR_clone3
+      SC_DENY(clone3, ENOSYS),
+#endif
 
 /* Syscalls to allow */
 #ifdef __NR_open
@@ -145,6 +217,35 @@ int restrict_process_init(void) {
       SC_ALLOW(exit_group),
 #endif
 
+/* threads */
+#ifdef __NR_futex
+      SC_ALLOW(futex),
+#endif
+#ifdef __NR_futex_time64
+      SC_ALLOW(futex_time64),
+#endif
+#ifdef __NR_set_robust_list
+      SC_ALLOW(set_robust_list),
+#endif
+#ifdef __NR_rseq
+      SC_ALLOW(rseq),
+#endif
+#ifdef __NR_rt_sigprocmask
+      SC_ALLOW(rt_sigprocmask),
+#endif
+#ifdef __NR_sched_yield
+      SC_ALLOW(sched_yield),
+#endif
+#ifdef __NR_exit
+      SC_ALLOW(exit),
+#endif
+#ifdef __NR_clone
+      SC_ALLOW_ARG_MASK(clone, 0, CLONE_THREAD),
+#endif
+#ifdef __NR_seccomp
+      SC_ALLOW(seccomp),
+#endif
+
 #ifdef __NR_fcntl
       SC_ALLOW(fcntl),
 #endif
@@ -186,6 +287,21 @@ int restrict_process_init(void) {
 #ifdef __NR_readv
       SC_ALLOW(readv),
 #endif
+#ifdef __NR_wait4
+      SC_ALLOW(wait4),
+#endif
+#ifdef __NR_waitid
+      SC_ALLOW(waitid),
+#endif
+#ifdef __NR_poll
+      SC_ALLOW(poll),
+#endif
+#ifdef __NR_ppoll
+      SC_ALLOW(ppoll),
+#endif
+#ifdef __NR_ppoll_time64
+      SC_ALLOW(ppoll_time64),
+#endif
 
 #ifdef __NR_sigaction
       SC_ALLOW(sigaction),
@@ -196,6 +312,12 @@ int restrict_process_init(void) {
 #ifdef __NR_sigreturn
       SC_ALLOW(sigreturn),
 #endif
+#ifdef __NR_rt_sigaction
+      SC_ALLOW(rt_sigaction),
+#endif
+#ifdef __NR_rt_sigreturn
+      SC_ALLOW(rt_sigreturn),
+#endif
 
 #ifdef __NR_write
       SC_ALLOW(write),
@@ -204,6 +326,58 @@ int restrict_process_init(void) {
       SC_ALLOW(writev),
 #endif
 
+#ifdef __NR_pipe
+      SC_ALLOW(pipe),
+#endif
+#ifdef __NR_pipe2
+      SC_ALLOW(pipe2),
+#endif
+#ifdef __NR_tee
+      SC_ALLOW(tee),
+#endif
+#ifdef __NR_splice
+      SC_ALLOW(splice),
+#endif
+
+/* io: the ring is created before the stdin restrictions are applied */
+#ifdef __NR_io_uring_setup
+      SC_ALLOW(io_uring_setup),
+#endif
+#ifdef __NR_io_uring_register
+      SC_ALLOW(io_uring_register),
+#endif
+#ifdef __NR_io_uring_enter
+      SC_ALLOW(io_uring_enter),
+#endif
+
+/* output files: rotation */
+#ifdef __NR_dup
+      SC_ALLOW(dup),
+#endif
+#ifdef __NR_dup2
+      SC_ALLOW(dup2),
+#endif
+#ifdef __NR_dup3
+      SC_ALLOW(dup3),
+#endif
+#ifdef __NR_renameat
+      SC_ALLOW(renameat),
+#endif
+#ifdef __NR_renameat2
+      SC_ALLOW(renameat2),
+#endif
+#ifdef __NR_fallocate
+      SC_ALLOW(fallocate),
+#endif
+#ifdef __NR_ftruncate
+      SC_ALLOW(ftruncate),
+#endif
+#ifdef RESTRICT_PROCESS_LANDLOCK
+      SC_ALLOW(landlock_create_ruleset),
+      SC_ALLOW(landlock_add_rule),
+      SC_ALLOW(landlock_restrict_self),
+#endif
+
 #ifdef __NR_getrandom
       SC_ALLOW(getrandom),
 #endif
@@ -220,13 +394,31 @@ int restrict_process_init(void) {
       .filter = filter,
   };
 
+  /* FIFO inputs and output files are opened using the allowed calls: the
+   * filter does not depend on the flags and is only installed once.
+   */
+  (void)flags;
+
+  if (restrict_process_filtered)
+    return 0;
+
   if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
     return -1;
 
-  return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+  if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) < 0)
+    return -1;
+
+  restrict_process_filtered = 1;
+
+  return 0;
 }
 
-int restrict_process_stdin(void) {
+int restrict_process_stdin(const int *fd, int nfd,
+                           const restrict_process_dir_t *dir) {
+  unsigned int dirfd = dir == NULL ? (unsigned int)-1 : (unsigned int)dir->fd;
+  unsigned int spare =
+      dir == NULL ? (unsigned int)-1 : (unsigned int)dir->spare;
+  unsigned int flags = dir == NULL ? 0 : (unsigned int)dir->flags;
   struct sock_filter filter[] = {
       /* Ensure the syscall arch convention is as expected. */
       BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, arch)),
@@ -235,6 +427,41 @@ int restrict_process_stdin(void) {
       /* Load the syscall number for checking. */
       BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),
 
+/* rotation: files are opened and renamed using the directory descriptor.
+ * The new file is opened on the spare descriptor, moved to the output
+ * descriptor and the spare descriptor closed.
+ *
+ * The filter only matches the directory descriptor argument: an absolute
+ * path or a path containing ".." is not confined to the directory by the
+ * filter. Paths are confined by landlock(7) if supported by the kernel.
+ * Files can only be opened with the flags of the output file (append
+ * only, not read).
+ */
+#ifdef __NR_openat
+      SC_DIR_ALLOW_OPENAT(dirfd, flags),
+#endif
+#ifdef __NR_renameat
+      SC_DIR_ALLOW_ARG2(renameat, 0, 2, dirfd),
+#endif
+#ifdef __NR_renameat2
+      SC_DIR_ALLOW_ARG2(renameat2, 0, 2, dirfd),
+#endif
+#ifdef __NR_dup2
+      SC_DIR_ALLOW_ARG(dup2, 0, spare),
+#endif
+#ifdef __NR_dup3
+      SC_DIR_ALLOW_ARG(dup3, 0, spare),
+#endif
+#ifdef __NR_close
+      SC_DIR_ALLOW_ARG(close, 0, spare),
+#endif
+#ifdef __NR_fallocate
+      SC_DIR_ALLOW(fallocate),
+#endif
+#ifdef __NR_ftruncate
+      SC_DIR_ALLOW(ftruncate),
+#endif
+
 /* Syscalls to non-fatally deny */
 #ifdef __NR_open
       SC_DENY(open, EACCES),
@@ -311,6 +538,29 @@ int restrict_process_stdin(void) {
       SC_ALLOW(exit_group),
 #endif
 
+/* threads */
+#ifdef __NR_futex
+      SC_ALLOW(futex),
+#endif
+#ifdef __NR_futex_time64
+      SC_ALLOW(futex_time64),
+#endif
+#ifdef __NR_set_robust_list
+      SC_ALLOW(set_robust_list),
+#endif
+#ifdef __NR_rseq
+      SC_ALLOW(rseq),
+#endif
+#ifdef __NR_rt_sigprocmask
+      SC_ALLOW(rt_sigprocmask),
+#endif
+#ifdef __NR_sched_yield
+      SC_ALLOW(sched_yield),
+#endif
+#ifdef __NR_exit
+      SC_ALLOW(exit),
+#endif
+
 #ifdef __NR_gettimeofday
       SC_ALLOW(gettimeofday),
 #endif
@@ -333,6 +583,21 @@ int restrict_process_stdin(void) {
 #ifdef __NR_readv
       SC_ALLOW(readv),
 #endif
+#ifdef __NR_wait4
+      SC_ALLOW(wait4),
+#endif
+#ifdef __NR_waitid
+      SC_ALLOW(waitid),
+#endif
+#ifdef __NR_poll
+      SC_ALLOW(poll),
+#endif
+#ifdef __NR_ppoll
+      SC_ALLOW(ppoll),
+#endif
+#ifdef __NR_ppoll_time64
+      SC_ALLOW(ppoll_time64),
+#endif
 
 #ifdef __NR_sigaction
       SC_ALLOW(sigaction),
@@ -343,12 +608,29 @@ int restrict_process_stdin(void) {
 #ifdef __NR_sigreturn
       SC_ALLOW(sigreturn),
 #endif
+#ifdef __NR_rt_sigaction
+      SC_ALLOW(rt_sigaction),
+#endif
+#ifdef __NR_rt_sigreturn
+      SC_ALLOW(rt_sigreturn),
+#endif
 #ifdef __NR_write
       SC_ALLOW(write),
 #endif
 #ifdef __NR_writev
       SC_ALLOW(writev),
 #endif
+#ifdef __NR_tee
+      SC_ALLOW(tee),
+#endif
+#ifdef __NR_splice
+      SC_ALLOW(splice),
+#endif
+
+/* io: the ring is restricted to reads and writes */
+#ifdef __NR_io_uring_enter
+      SC_ALLOW(io_uring_enter),
+#endif
 
 #ifdef __NR_getrandom
       SC_ALLOW(getrandom),
@@ -366,6 +648,85 @@ int restrict_process_stdin(void) {
       .filter = filter,
   };
 
+  /* Writes are not restricted by descriptor. */
+  (void)fd;
+  (void)nfd;
+
+  /* Apply the filter to all threads. */
+#ifdef __NR_seccomp
+  if (syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_TSYNC,
+              &prog) == 0)
+    return 0;
+
+  if (errno != ENOSYS)
+    return -1;
+#endif
+
   return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
 }
+/* rotation: the seccomp filter cannot inspect paths. Files opened and
+ * renamed in the directory are confined by a landlock(7) ruleset. Unlike
+ * the seccomp filter, the ruleset is only inherited by threads started
+ * after it is applied.
+ *
+ * If landlock is not supported, paths are not confined.
+ */
+int restrict_process_dir(const restrict_process_dir_t *dir) {
+#ifdef RESTRICT_PROCESS_LANDLOCK
+  struct landlock_ruleset_attr attr = {0};
+  struct landlock_path_beneath_attr rule = {0};
+  int abi;
+  int fd;
+  int oerrno;
+
+  abi = (int)syscall(__NR_landlock_create_ruleset, NULL, 0,
+                     LANDLOCK_CREATE_RULESET_VERSION);
+  if (abi < 0)
+    return (errno == ENOSYS || errno == EOPNOTSUPP) ? 0 : -1;
+
+  attr.handled_access_fs =
+      LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_WRITE_FILE |
+      LANDLOCK_ACCESS_FS_READ_FILE | LANDLOCK_ACCESS_FS_READ_DIR |
+      LANDLOCK_ACCESS_FS_REMOVE_DIR | LANDLOCK_ACCESS_FS_REMOVE_FILE |
+      LANDLOCK_ACCESS_FS_MAKE_CHAR | LANDLOCK_ACCESS_FS_MAKE_DIR |
+      LANDLOCK_ACCESS_FS_MAKE_REG | LANDLOCK_ACCESS_FS_MAKE_SOCK |
+      LANDLOCK_ACCESS_FS_MAKE_FIFO | LANDLOCK_ACCESS_FS_MAKE_BLOCK |
+      LANDLOCK_ACCESS_FS_MAKE_SYM;
+
+  /* files are created, appended to and renamed in the directory */
+  rule.allowed_access = LANDLOCK_ACCESS_FS_WRITE_FILE |
+                        LANDLOCK_ACCESS_FS_REMOVE_FILE |
+                        LANDLOCK_ACCESS_FS_MAKE_REG;
+  rule.parent_fd = dir->fd;
+
+#ifdef LANDLOCK_ACCESS_FS_REFER
+  if (abi >= 2)
+    attr.handled_access_fs |= LANDLOCK_ACCESS_FS_REFER;
+#endif
+#ifdef LANDLOCK_ACCESS_FS_TRUNCATE
+  if (abi >= 3) {
+    attr.handled_access_fs |= LANDLOCK_ACCESS_FS_TRUNCATE;
+    rule.allowed_access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+  }
+#endif
+
+  fd = (int)syscall(__NR_landlock_create_ruleset, &attr, sizeof(attr), 0);
+  if (fd < 0)
+    return -1;
+
+  if (syscall(__NR_landlock_add_rule, fd, LANDLOCK_RULE_PATH_BENEATH, &rule,
+              0) < 0 ||
+      syscall(__NR_landlock_restrict_self, fd, 0) < 0) {
+    oerrno = errno;
+    (void)close(fd);
+    errno = oerrno;
+    return -1;
+  }
+
+  return close(fd);
+#else
+  (void)dir;
+  return 0;
+#endif
+}
 #endif
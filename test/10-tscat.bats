@@ -90,3 +90,572 @@ EOF
     *) skip ;;
     esac
 }
+
+@test "stdin: final line without newline" {
+    run tscat --format="" test < <(printf 'a\nb')
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "$output" = "test a
+test b" ]
+}
+
+@test "stdin: sub-second timestamp" {
+    run tscat --format="%s.%3N|%6N|%N" <<<$PATH
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    match="^[0-9]+\.[0-9]{3}\|[0-9]{6}\|[0-9]{9} /"
+
+    [ "$status" -eq 0 ]
+    [[ "$output" =~ $match ]]
+}
+
+@test "stdin: UTC timestamp" {
+    TZ=America/New_York run tscat --utc --format="%z %Z" <<<$PATH
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    match="^\+0000 UTC /"
+
+    [ "$status" -eq 0 ]
+    [[ "$output" =~ $match ]]
+}
+
+@test "stdout: batched output" {
+    run tscat --format="" --flush=batch < <(seq 1 1000)
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 1000 ]
+    [ "${lines[999]}" = "1000" ]
+}
+
+@test "stdin: threaded reader and writer" {
+    run tscat --format="" --threads < <(seq 1 1000)
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 1000 ]
+    [ "${lines[999]}" = "1000" ]
+}
+
+@test "stdout: queue output while the consumer is blocked" {
+    run bash -c 'seq 1 100000 | tscat -W queue=65536 --pipe-size=0 --format="" | (sleep 1; cat)'
+    cat << EOF
+--- output
+${lines[-1]}
+--- output
+EOF
+    match="^tscat: dropped [0-9]+ lines \([0-9]+ bytes\)$"
+
+    [ "$status" -eq 0 ]
+    [[ "${lines[-1]}" =~ $match ]]
+    [ "${lines[-2]}" = "100000" ]
+}
+
+@test "output-format: json: queue writes the drop count as a record" {
+    command -v python3 > /dev/null || skip "python3 not found"
+    run bash -c 'seq 1 300000 | tscat --output-format=json -W queue=65536 --pipe-size=0 L | (sleep 1; cat) | python3 -c "
+import json, sys
+for line in sys.stdin:
+    r = json.loads(line)
+    if \"dropped\" in r:
+        print(r[\"dropped\"], r[\"dropped_bytes\"])
+"'
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    match="^[0-9]+ [0-9]+$"
+
+    [ "$status" -eq 0 ]
+    [[ "${lines[-1]}" =~ $match ]]
+}
+
+@test "sink: write to inherited descriptors" {
+    run bash -c 'seq 1 3 | tscat --format="" -o 0 --sink fd=3 --sink fd=4,write-error=drop 3>&1 4>&1'
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "$output" = "1
+1
+2
+2
+3
+3" ]
+}
+
+@test "stats: summary on exit" {
+    run bash -c 'seq 1 10 | tscat --stats=1 -o 0'
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "tscat: stats: lines=10 bytes=21" ]
+    [[ "${lines[1]}" =~ ^"tscat: stats: latency_us " ]]
+}
+
+@test "stdin: split long lines" {
+    run tscat --format="" --max-line=40 --long-line=split < <(printf '%0100d\n%040d\n' 0 0)
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 4 ]
+    [ "${#lines[2]}" -eq 20 ]
+    [ "${#lines[3]}" -eq 40 ]
+}
+
+@test "stdin: truncate long lines" {
+    run tscat --format="" --max-line=40 --long-line=truncate < <(printf '%0100d\nabc\n' 0)
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 2 ]
+    [ "${#lines[0]}" -eq 40 ]
+    [ "${lines[1]}" = "abc" ]
+}
+
+@test "input: merge inherited descriptors" {
+    run tscat --format="" --input fd=3,label=a --input fd=4 b 3< <(printf '1\n2\n') 4< <(sleep 0.2; printf '3\n')
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "a 1" ]
+    [ "${lines[1]}" = "a 2" ]
+    [ "${lines[2]}" = "b 3" ]
+}
+
+@test "relative: elapsed time since start" {
+    run tscat --relative=start --clock=monotonic --format="%s" < <(printf '1\n2\n')
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "0 1" ]
+    [ "${lines[1]}" = "0 2" ]
+}
+
+@test "exec: label stdout and stderr of a command" {
+    run tscat --format="" web -- sh -c 'echo out; sleep 0.2; echo err >&2; exit 3'
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 3 ]
+    [ "${lines[0]}" = "web.out out" ]
+    [ "${lines[1]}" = "web.err err" ]
+}
+
+@test "file: batch output to a regular file" {
+    run bash -c 'seq 1 1000 | tscat --format="" --buffer-size=4096 >"$BATS_TMPDIR/tscat.out"; wc -l < "$BATS_TMPDIR/tscat.out"'
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[-1]}" = "1000" ]
+}
+
+@test "stdin: NUL terminated records" {
+    run bash -c 'printf "a\nb\0c\0" | tscat --null --format="" test | tr "\0" "|"'
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "test a" ]
+    [ "${lines[1]}" = "b|test c|" ]
+}
+
+@test "output: json" {
+    run tscat --format="" --output-format=json test < <(printf 'say "hi"\t\n')
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "$output" = '{"label":"test","msg":"say \"hi\"\t"}' ]
+}
+
+@test "output: binary records and decode" {
+    run bash -c "printf 'a\nb\nc' | tscat --output-format=binary test | tscat --decode --format=''"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "test a" ]
+    [ "${lines[1]}" = "test b" ]
+    [ "${lines[2]}" = "test c" ]
+}
+
+@test "output: rotate the output file" {
+    dir="$BATS_TEST_TMPDIR"
+    run tscat --format="" --output-file="$dir/log" --rotate-size=4 --rotate-count=2 test < <(printf 'a\nb\nc\n')
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "$(cat "$dir/log")" = "test c" ]
+    [ "$(cat "$dir/log.1")" = "test b" ]
+    [ "$(cat "$dir/log.2")" = "test a" ]
+    [ -z "$output" ]
+}
+
+@test "output: gzip compression" {
+    if ! tscat --compress=gzip < /dev/null > /dev/null 2>&1; then
+        skip "built without compression"
+    fi
+    run bash -c "printf 'a\nb\n' | tscat --format='' --compress=gzip test | gzip -dc"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "test a" ]
+    [ "${lines[1]}" = "test b" ]
+}
+
+
+@test "io: io_uring backend" {
+    run bash -c "seq 1 3 | tscat --format='' --io=uring test"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "test 1" ]
+    [ "${lines[1]}" = "test 2" ]
+    [ "${lines[2]}" = "test 3" ]
+}
+
+
+@test "library: stream output matches tscat" {
+    lib="$BATS_TEST_DIRNAME/.."
+    if [ ! -f "$lib/libtscat.so" ]; then
+        skip "libtscat.so not built"
+    fi
+    "${CC-cc}" -o "$BATS_TEST_TMPDIR/tslib" -I"$lib" "$BATS_TEST_DIRNAME/tslib.c" \
+        -L"$lib" -Wl,-rpath,"$lib" -ltscat
+    input='first line\nsecond line is longer\nthird'
+    run bash -c "printf '$input' | '$BATS_TEST_TMPDIR/tslib' '' test 2>/dev/null"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "$output" = "$(printf "$input" | tscat --format='' test)" ]
+    [ "${lines[2]}" = "test third" ]
+}
+
+@test "reformat: replace the timestamps of tscat output" {
+    file="$BATS_TEST_TMPDIR/log"
+    printf '1700000000 test a\nno timestamp\n1700000001 test b\n' > "$file"
+    run tscat --reformat --from-format='%s' --format='%FT%T' --utc < "$file"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "2023-11-14T22:13:20 test a" ]
+    [ "${lines[1]}" = "no timestamp" ]
+    [ "${lines[2]}" = "2023-11-14T22:13:21 test b" ]
+}
+
+@test "rate: suppress lines exceeding the rate" {
+    run bash -c "seq 1 100 | tscat --format='' --rate=3/s,burst=2 test"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 3 ]
+    [ "${lines[0]}" = "test 1" ]
+    [ "${lines[1]}" = "test 2" ]
+    [[ "${lines[2]}" =~ ^"test tscat: suppressed 98 lines in " ]]
+}
+
+@test "decode: records longer than a chunk are rejected" {
+    file="$BATS_TEST_TMPDIR/tsb"
+    ts='\x00\x00\x00\x00\x00\x00\x00\x00'
+    {
+        printf "TSCAT\0\1\n\x00\x00\x00\x00\x00\x00\x02\x00$ts"
+        printf "\x60\xea\x00\x00\x00\x00\x00\x00$ts"
+        head -c 60000 /dev/zero | tr '\0' '\1'
+    } > "$file"
+    run tscat --decode --output-format=json < "$file"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 1 ]
+    [ "$output" = "tscat: decode: Bad message" ]
+
+    # a label longer than a chunk is escaped
+    {
+        printf "TSCAT\0\1\n\x20\x4e\x00\x00\x00\x00\x02\x00$ts"
+        head -c 20000 /dev/zero | tr '\0' '\1'
+        printf "\x03\x00\x00\x00\x00\x00\x00\x00${ts}hi\n"
+    } > "$file"
+    run tscat --decode --output-format=json --format='' < "$file"
+    [ "$status" -eq 0 ]
+    [ "${#output}" -eq 120023 ]
+}
+
+@test "output: drop and queue append to an existing file" {
+    file="$BATS_TEST_TMPDIR/log"
+    printf 'OLD LINE 1\nOLD LINE 2\n' > "$file"
+    echo a | tscat --format='' --write-error=drop --output-file="$file" test
+    echo b | tscat --format='' --write-error=queue=65536 test >> "$file"
+    run cat "$file"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "OLD LINE 1" ]
+    [ "${lines[1]}" = "OLD LINE 2" ]
+    [ "${lines[2]}" = "test a" ]
+    [ "${lines[3]}" = "test b" ]
+}
+
+@test "output: binary records are not dropped" {
+    run bash -c "echo a | tscat --output-format=binary --write-error=queue=65536"
+    [ "$status" -eq 2 ]
+    [ "$output" = "tscat: binary: --write-error=drop|queue is not supported" ]
+    run bash -c "echo a | tscat --output-format=binary --sink=fd=1,write-error=drop"
+    [ "$status" -eq 2 ]
+}
+
+@test "output: preallocated space is released on exit" {
+    file="$BATS_TEST_TMPDIR/log"
+    echo hi | tscat --output-file="$file" --rotate-size=104857600
+    run du -k "$file"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${output%%[[:space:]]*}" -lt 1024 ]
+}
+
+@test "output: binary output rotates an existing file" {
+    file="$BATS_TEST_TMPDIR/log"
+    echo a | tscat --output-format=binary --output-file="$file" test
+    echo b | tscat --output-format=binary --output-file="$file" test
+    run tscat --decode --format='' < "$file"
+    [ "$status" -eq 0 ]
+    [ "$output" = "test b" ]
+    run tscat --decode --format='' < "$file.1"
+    [ "$status" -eq 0 ]
+    [ "$output" = "test a" ]
+}
+
+@test "input: a partial line does not hold the output indefinitely" {
+    run bash -c "tscat --format='' --input fd=3,label=a --input fd=4,label=b \
+        3< <(head -c 20000 /dev/zero | tr '\0' x; sleep 2; echo) \
+        4< <(sleep 0.2; echo b)"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "b b" ]
+    [ "${#lines[0]}" -eq 16386 ]
+}
+
+@test "output: stderr duplicated from stdout" {
+    dir="$BATS_TEST_TMPDIR"
+    mkfifo "$dir/stderr"
+    { seq 1 2000; head -c 20000 /dev/zero | tr '\0' x; echo; } > "$dir/in"
+    for flush in line batch; do
+        cat "$dir/stderr" > "$dir/err" &
+        tscat --format='' --output=3 --flush=$flush test < "$dir/in" \
+            2> "$dir/stderr" | cat > "$dir/out"
+        wait $!
+        run cmp "$dir/out" "$dir/err"
+        [ "$status" -eq 0 ]
+        [ "$(wc -l < "$dir/out")" -eq 2001 ]
+    done
+}
+
+@test "library: only the tscat_ functions are exported" {
+    lib="$BATS_TEST_DIRNAME/.."
+    if [ ! -f "$lib/libtscat.so" ]; then
+        skip "libtscat.so not built"
+    fi
+    if ! command -v nm > /dev/null; then
+        skip "nm not found"
+    fi
+    run bash -c "nm -D --defined-only '$lib/libtscat.so' | awk '\$2 == \"T\" { print \$3 }' | grep -v '^tscat_'"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$output" = "" ]
+}
+
+@test "library: the flags of a sink are restored on close" {
+    lib="$BATS_TEST_DIRNAME/.."
+    if [ ! -f "$lib/libtscat.so" ]; then
+        skip "libtscat.so not built"
+    fi
+    "${CC-cc}" -o "$BATS_TEST_TMPDIR/tslib" -I"$lib" "$BATS_TEST_DIRNAME/tslib.c" \
+        -L"$lib" -Wl,-rpath,"$lib" -ltscat
+    run bash -c "echo a | '$BATS_TEST_TMPDIR/tslib' '' test drop 2>&1 >/dev/null | cat"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "$output" = "lines=1 bytes=2 nonblock=0" ]
+}
+
+@test "output: gzip compresses stdout and the output file only" {
+    if ! tscat --compress=gzip < /dev/null > /dev/null 2>&1; then
+        skip "built without compression"
+    fi
+    run bash -c "echo a | tscat --compress=gzip --write-error=drop"
+    [ "$status" -eq 2 ]
+    [ "$output" = "tscat: --compress: --write-error=drop|exit|queue is not supported" ]
+
+    run bash -c "echo a | tscat --format='' --compress=gzip --output=3 test 2>&1 >/dev/null"
+    [ "$status" -eq 0 ]
+    [ "$output" = "test a" ]
+
+    run bash -c "echo a | tscat --format='' --compress=gzip --output=1 --sink=fd=2,write-error=drop test 2>&1 >/dev/null"
+    [ "$status" -eq 0 ]
+    [ "$output" = "test a" ]
+}
+
+@test "reformat: write error policies are rejected" {
+    file="$BATS_TEST_TMPDIR/log"
+    echo '1700000000 test a' > "$file"
+    run tscat --reformat --from-format='%s' --write-error=drop < "$file"
+    [ "$status" -eq 2 ]
+    [ "$output" = "tscat: --reformat: --write-error=drop|exit|queue is not supported" ]
+}
+
+@test "exec: options are parsed before the command" {
+    run bash -c "echo a | tscat -f -- test"
+    [ "$status" -eq 0 ]
+    [ "$output" = "-- test a" ]
+
+    run bash -c "echo a | tscat --format='' -- -test"
+    [ "$status" -eq 0 ]
+    [ "$output" = "-test a" ]
+
+    run tscat --format='' -- sh -c 'echo out'
+    [ "$status" -eq 0 ]
+    [ "$output" = "sh.out out" ]
+}
+
+@test "rate: suppressed lines are reported without further input" {
+    run bash -c "{ printf 'a\nb\nc\n'; sleep 3; } | timeout 2 tscat --format='' --rate=1/s test"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 124 ]
+    [ "${lines[0]}" = "test a" ]
+    [[ "${lines[1]}" =~ ^"test tscat: suppressed 2 lines in 1." ]]
+}
+
+@test "output: logfmt" {
+    run tscat --format="" --output-format=logfmt 'a label' < <(printf 'bare\nsay "hi"\n')
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = 'label="a label" msg=bare' ]
+    [ "${lines[1]}" = 'label="a label" msg="say \"hi\""' ]
+}
+
+@test "output: control bytes and invalid UTF-8 are escaped" {
+    input='a\x01b\x1f\tc\xff\xfed\xc3\xa9"\\\n'
+    run tscat --format="" --output-format=json test < <(printf "$input")
+    [ "$status" -eq 0 ]
+    [ "$output" = '{"label":"test","msg":"a\u0001b\u001f\tc\ufffd\ufffddé\"\\"}' ]
+
+    run tscat --format="" --output-format=logfmt test < <(printf "$input")
+    [ "$status" -eq 0 ]
+    [ "$output" = 'label=test msg="a\u0001b\u001f\tc\ufffd\ufffddé\"\\"' ]
+}
+
+@test "output: records of a long line are marked as partial" {
+    run bash -c "{ head -c 20000 /dev/zero | tr '\0' x; echo; } | tscat --format='' --output-format=json test | sed 's/xx*/x/'"
+    cat << EOF
+--- output
+$output
+--- output
+EOF
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = '{"label":"test","msg":"x","partial":true}' ]
+    [ "${lines[1]}" = '{"label":"test","msg":"x"}' ]
+
+    run bash -c "{ head -c 20000 /dev/zero | tr '\0' x; echo; } | tscat --format='' --output-format=logfmt test | sed 's/xx*/x/'"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = 'label=test msg=x partial=true' ]
+    [ "${lines[1]}" = 'label=test msg=x' ]
+}
+
+@test "stdin: local timestamp" {
+    TZ=America/New_York run tscat --format="%z %Z" <<<test
+    [ "$status" -eq 0 ]
+    [ "$output" = "$(TZ=America/New_York date '+%z %Z') test" ]
+}
+
+@test "exec: an argument after -- is the command" {
+    run bash -c "echo a | tscat --format='' -- tscat-nonexistent-label"
+    [ "$status" -eq 127 ]
+
+    run bash -c "echo a | tscat --format='' -- -label"
+    [ "$status" -eq 0 ]
+    [ "$output" = "-label a" ]
+
+    run bash -c "echo a | tscat --format='' label"
+    [ "$status" -eq 0 ]
+    [ "$output" = "label a" ]
+}
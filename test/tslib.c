@@ -0,0 +1,62 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libtscat.h"
+
+/* Copy stdin to a library stream writing to stdout.
+ *
+ * tslib <format> <label> [<write-error>]
+ *
+ * Input is written to the stream in small, unaligned chunks.
+ */
+int main(int argc, char *argv[]) {
+  tscat_t *t;
+  tscat_stats_t st;
+  char buf[7];
+  ssize_t n;
+
+  if (argc != 3 && argc != 4)
+    errx(2, "usage: tslib <format> <label> [<write-error>]");
+
+  t = tscat_open(argv[1], argv[2]);
+  if (t == NULL)
+    err(EXIT_FAILURE, "tscat_open");
+
+  if (tscat_sink(t, STDOUT_FILENO, argc == 4 ? argv[3] : NULL) < 0)
+    err(EXIT_FAILURE, "tscat_sink");
+
+  while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+    if (tscat_write(t, buf, n) < 0)
+      err(EXIT_FAILURE, "tscat_write");
+  }
+
+  if (n < 0)
+    err(EXIT_FAILURE, "read");
+
+  tscat_stats(t, &st);
+
+  if (tscat_close(t) < 0)
+    err(EXIT_FAILURE, "tscat_close");
+
+  (void)fprintf(stderr, "lines=%llu bytes=%llu nonblock=%d\n", st.lines,
+                st.bytes, (fcntl(STDOUT_FILENO, F_GETFL) & O_NONBLOCK) != 0);
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "tsbin.h"
+
+static void tsbin_put(char *buf, uint64_t v, int n);
+static uint64_t tsbin_get(const char *buf, int n);
+
+/* The header is encoded byte by byte: the format does not depend on the
+ * byte order or alignment of the host.
+ */
+void tsbin_encode(char *buf, const tsbin_hdr_t *h) {
+  tsbin_put(buf, h->len, 4);
+  tsbin_put(buf + 4, h->id, 2);
+  tsbin_put(buf + 6, h->flags, 2);
+  tsbin_put(buf + 8, h->ts, 8);
+}
+
+void tsbin_decode(const char *buf, tsbin_hdr_t *h) {
+  h->len = tsbin_get(buf, 4);
+  h->id = tsbin_get(buf + 4, 2);
+  h->flags = tsbin_get(buf + 6, 2);
+  h->ts = tsbin_get(buf + 8, 8);
+}
+
+/* Times before the epoch are not representable. */
+uint64_t tsbin_nsec(const struct timespec *ts) {
+  if (ts->tv_sec < 0)
+    return 0;
+
+  return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+void tsbin_timespec(uint64_t nsec, struct timespec *ts) {
+  ts->tv_sec = nsec / 1000000000ULL;
+  ts->tv_nsec = nsec % 1000000000ULL;
+}
+
+static void tsbin_put(char *buf, uint64_t v, int n) {
+  int i;
+
+  for (i = 0; i < n; i++)
+    buf[i] = (v >> (i * 8)) & 0xff;
+}
+
+static uint64_t tsbin_get(const char *buf, int n) {
+  uint64_t v = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    v |= (uint64_t)(unsigned char)buf[i] << (i * 8);
+
+  return v;
+}
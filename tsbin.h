@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <time.h>
+
+/* Binary records: a stream starts with the magic, followed by records.
+ *
+ * Each record is a 16 byte little endian header followed by the data:
+ *
+ *   uint32_t length of the data
+ *   uint16_t label id
+ *   uint16_t flags
+ *   uint64_t timestamp in nanoseconds
+ *
+ * A label record defines the label for an id: the data is the label.
+ */
+#define TSBIN_MAGIC "TSCAT\0\1\n"
+#define TSBIN_MAGICLEN 8
+#define TSBIN_HDRLEN 16
+
+/* TSBIN_CONT: the record continues the line of the previous record */
+enum { TSBIN_CONT = 1, TSBIN_LABEL = 2 };
+
+typedef struct {
+  uint32_t len;
+  uint16_t id;
+  uint16_t flags;
+  uint64_t ts;
+} tsbin_hdr_t;
+
+void tsbin_encode(char *buf, const tsbin_hdr_t *h);
+void tsbin_decode(const char *buf, tsbin_hdr_t *h);
+uint64_t tsbin_nsec(const struct timespec *ts);
+void tsbin_timespec(uint64_t nsec, struct timespec *ts);
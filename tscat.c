@@ -12,43 +12,108 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
-#include "getnline.h"
+#include "tscat_int.h"
 #include "restrict_process.h"
 #include "strtonum.h"
 
 #define TS_VERSION "0.3.5"
 
-enum { TS_WR_BLOCK = 0, TS_WR_DROP, TS_WR_EXIT };
+enum {
+  OPT_FLUSH = 256,
+  OPT_THREADS,
+  OPT_SINK,
+  OPT_STATS,
+  OPT_STATS_INTERVAL,
+  OPT_MAX_LINE,
+  OPT_LONG_LINE,
+  OPT_INPUT,
+  OPT_CLOCK,
+  OPT_RELATIVE,
+  OPT_PIPE_SIZE,
+  OPT_BUFFER_SIZE,
+  OPT_DELIMITER,
+  OPT_OUTPUT_FORMAT,
+  OPT_DECODE,
+  OPT_OUTPUT_FILE,
+  OPT_ROTATE_SIZE,
+  OPT_ROTATE_INTERVAL,
+  OPT_ROTATE_COUNT,
+  OPT_COMPRESS,
+  OPT_IO,
+  OPT_REFORMAT,
+  OPT_FROM_FORMAT,
+  OPT_RATE
+};
 
-typedef struct {
-  int output;
-  char *label;
-  char *format;
-  int write_error;
-  int print_timestamp;
-} ts_state_t;
-
-static int tscatin(ts_state_t *s);
-static int tscatout(ts_state_t *s, char *buf, size_t buflen);
+static int tscatclock(const char *arg, clockid_t *clock);
+static int tscatcompression(const char *arg, int *level);
+static int tscatrate(const char *arg, tsrate_t *r);
+static int tscatsink(ts_state_t *s, const char *arg);
+static int tscatwriteerror(const ts_state_t *s, int write_error);
+static int tscatinput(ts_state_t *s, const char *arg);
+static pid_t tscatexec(ts_state_t *s, const char *label, char *argv[]);
+static int tscatstatus(pid_t pid);
+static int tscatstatsinit(ts_state_t *s);
+static void *tscatstatswriter(void *arg);
+static void tscatstats(ts_state_t *s);
+static void tscatsignal(int sig);
 static void usage(void);
 
 extern char *__progname;
 
+/* stats: SIGUSR1 is forwarded to the stats thread using a pipe */
+static int tscat_stats_signal = -1;
+
 static const struct option long_options[] = {
     {"format", required_argument, NULL, 'f'},
     {"output", required_argument, NULL, 'o'},
     {"write-error", required_argument, NULL, 'W'},
+    {"utc", no_argument, NULL, 'u'},
+    {"null", no_argument, NULL, 'z'},
+    {"delimiter", required_argument, NULL, OPT_DELIMITER},
+    {"flush", required_argument, NULL, OPT_FLUSH},
+    {"threads", optional_argument, NULL, OPT_THREADS},
+    {"sink", required_argument, NULL, OPT_SINK},
+    {"stats", optional_argument, NULL, OPT_STATS},
+    {"stats-interval", required_argument, NULL, OPT_STATS_INTERVAL},
+    {"max-line", required_argument, NULL, OPT_MAX_LINE},
+    {"long-line", required_argument, NULL, OPT_LONG_LINE},
+    {"input", required_argument, NULL, OPT_INPUT},
+    {"clock", required_argument, NULL, OPT_CLOCK},
+    {"relative", required_argument, NULL, OPT_RELATIVE},
+    {"pipe-size", required_argument, NULL, OPT_PIPE_SIZE},
+    {"buffer-size", required_argument, NULL, OPT_BUFFER_SIZE},
+    {"output-format", required_argument, NULL, OPT_OUTPUT_FORMAT},
+    {"decode", no_argument, NULL, OPT_DECODE},
+    {"output-file", required_argument, NULL, OPT_OUTPUT_FILE},
+    {"rotate-size", required_argument, NULL, OPT_ROTATE_SIZE},
+    {"rotate-interval", required_argument, NULL, OPT_ROTATE_INTERVAL},
+    {"rotate-count", required_argument, NULL, OPT_ROTATE_COUNT},
+    {"compress", required_argument, NULL, OPT_COMPRESS},
+    {"io", required_argument, NULL, OPT_IO},
+    {"reformat", no_argument, NULL, OPT_REFORMAT},
+    {"from-format", required_argument, NULL, OPT_FROM_FORMAT},
+    {"rate", required_argument, NULL, OPT_RATE},
     {"help", no_argument, NULL, 'h'},
     {NULL, 0, NULL, 0}};
 
@@ -57,46 +122,207 @@ int main(int argc, char *argv[]) {
   ts_state_t s = {0};
   time_t now;
   const char *errstr = NULL;
+  int *fd;
+  int nfd = 0;
+  char **cmd = NULL;
+  pid_t pid = -1;
+  const char *label = NULL;
+  restrict_process_dir_t dir = {0};
+  int output = -1;
+  int rflags = 0;
+  int rinit = -1;
+  int i;
 
-  now = time(NULL);
-  if (now == -1)
-    err(EXIT_FAILURE, "time");
-
-  /* Initialize timezone before enabling process restrictions.
-   *
-   * localtime(3) reads /etc/timezone.
+  /* The process is restricted before the options are parsed unless a
+   * command may be started: an argument is "--". FIFO inputs and the
+   * output file may be opened until the options are parsed.
    */
-  (void)localtime(&now);
-
-  if (restrict_process_init() < 0)
-    err(EXIT_FAILURE, "restrict_process_init");
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--") == 0)
+      break;
+  }
 
-  if (setvbuf(stdout, NULL, _IOLBF, 0) < 0)
-    err(EXIT_FAILURE, "setvbuf");
+  if (i == argc) {
+    rinit = RESTRICT_PROCESS_FIFO | RESTRICT_PROCESS_FILE;
+    if (restrict_process_init(rinit) < 0)
+      err(EXIT_FAILURE, "restrict_process_init");
+  }
 
-  s.output = STDOUT_FILENO;
-  s.print_timestamp = 1;
+  tscatdefaults(&s);
 
-  while ((ch = getopt_long(argc, argv, "f:ho:W:", long_options, NULL)) != -1) {
+  /* Arguments are parsed in order: the label is the first operand. */
+  while ((ch = getopt_long(argc, argv, "-f:ho:uW:z", long_options, NULL)) !=
+         -1) {
     switch (ch) {
+    case 1:
+      if (label == NULL)
+        label = optarg;
+      break;
     case 'f':
       s.format = optarg;
       break;
     case 'o':
-      s.output = strtonum(optarg, 0, 3, &errstr);
+      output = strtonum(optarg, 0, 3, &errstr);
       if (errstr != NULL)
         errx(2, "strtonum: %s", errstr);
       break;
+    case 'u':
+      s.tz.utc = 1;
+      break;
+    case 'z':
+      s.delim = '\0';
+      break;
+    case OPT_DELIMITER:
+      if (strlen(optarg) != 1)
+        errx(2, "invalid option: %s: <character>", optarg);
+      s.delim = (unsigned char)optarg[0];
+      break;
     case 'W':
-      if (strcmp(optarg, "block") == 0)
-        s.write_error = TS_WR_BLOCK;
-      else if (strcmp(optarg, "drop") == 0)
-        s.write_error = TS_WR_DROP;
-      else if (strcmp(optarg, "exit") == 0)
-        s.write_error = TS_WR_EXIT;
+      if (tscatpolicy(optarg, &s.write_error, &s.queue_size) < 0)
+        errx(2, "invalid option: %s: block|drop|exit|queue=<bytes>", optarg);
+      break;
+    case OPT_SINK:
+      if (tscatsink(&s, optarg) < 0)
+        errx(2, "invalid option: %s: fd=<fd>[,write-error=<policy>]", optarg);
+      break;
+    case OPT_INPUT:
+      if (tscatinput(&s, optarg) < 0)
+        errx(2, "invalid option: %s: fd=<fd>|fifo=<path>[,label=<label>]",
+             optarg);
+      break;
+    case OPT_FLUSH:
+      if (strcmp(optarg, "line") == 0)
+        s.flush = TS_FLUSH_LINE;
+      else if (strcmp(optarg, "batch") == 0)
+        s.flush = TS_FLUSH_BATCH;
+      else {
+        s.flush = TS_FLUSH_INTERVAL;
+        s.flush_interval = strtonum(optarg, 1, INT_MAX, &errstr);
+        if (errstr != NULL)
+          errx(2, "invalid option: %s: line|batch|<ms>", optarg);
+      }
+      break;
+    case OPT_THREADS:
+      s.threads = 1;
+      s.ring_size = TSRING_SIZE;
+      if (optarg != NULL) {
+        s.ring_size = strtonum(optarg, 65536, 1 << 30, &errstr);
+        if (errstr != NULL)
+          errx(2, "strtonum: %s", errstr);
+      }
+      break;
+    case OPT_STATS:
+      s.stats_fd = STDERR_FILENO;
+      if (optarg != NULL) {
+        s.stats_fd = strtonum(optarg, 1, INT_MAX, &errstr);
+        if (errstr != NULL)
+          errx(2, "strtonum: %s", errstr);
+      }
+      break;
+    case OPT_STATS_INTERVAL:
+      s.stats_interval = strtonum(optarg, 1, INT_MAX, &errstr);
+      if (errstr != NULL)
+        errx(2, "strtonum: %s", errstr);
+      break;
+    case OPT_MAX_LINE:
+      if (strcmp(optarg, "unlimited") == 0)
+        s.max_line = 0;
+      else {
+        s.max_line = strtonum(optarg, 1, INT_MAX, &errstr);
+        if (errstr != NULL)
+          errx(2, "invalid option: %s: <bytes>|unlimited", optarg);
+      }
+      break;
+    case OPT_LONG_LINE:
+      if (strcmp(optarg, "stream") == 0)
+        s.long_line = TS_LONG_STREAM;
+      else if (strcmp(optarg, "split") == 0)
+        s.long_line = TS_LONG_SPLIT;
+      else if (strcmp(optarg, "truncate") == 0)
+        s.long_line = TS_LONG_TRUNCATE;
       else
-        errx(2, "invalid option: %s: block|drop|exit", optarg);
-
+        errx(2, "invalid option: %s: stream|split|truncate", optarg);
+      break;
+    case OPT_CLOCK:
+      if (tscatclock(optarg, &s.clock) < 0)
+        errx(2, "invalid option: %s: "
+                "realtime|realtime_coarse|monotonic|boottime",
+             optarg);
+      break;
+    case OPT_RELATIVE:
+      if (strcmp(optarg, "start") == 0)
+        s.relative = TS_RELATIVE_START;
+      else if (strcmp(optarg, "prev") == 0)
+        s.relative = TS_RELATIVE_PREV;
+      else
+        errx(2, "invalid option: %s: start|prev", optarg);
+      break;
+    case OPT_PIPE_SIZE:
+      s.pipe_size = strtonum(optarg, 0, INT_MAX, &errstr);
+      if (errstr != NULL)
+        errx(2, "strtonum: %s", errstr);
+      break;
+    case OPT_BUFFER_SIZE:
+      s.buffer_size = strtonum(optarg, 4096, 1 << 30, &errstr);
+      if (errstr != NULL)
+        errx(2, "strtonum: %s", errstr);
+      break;
+    case OPT_OUTPUT_FORMAT:
+      if (strcmp(optarg, "text") == 0)
+        s.output_format = TS_OUTPUT_TEXT;
+      else if (strcmp(optarg, "json") == 0)
+        s.output_format = TS_OUTPUT_JSON;
+      else if (strcmp(optarg, "logfmt") == 0)
+        s.output_format = TS_OUTPUT_LOGFMT;
+      else if (strcmp(optarg, "binary") == 0)
+        s.output_format = TS_OUTPUT_BINARY;
+      else
+        errx(2, "invalid option: %s: text|json|logfmt|binary", optarg);
+      break;
+    case OPT_DECODE:
+      s.decode = 1;
+      break;
+    case OPT_OUTPUT_FILE:
+      s.output_file = optarg;
+      break;
+    case OPT_ROTATE_SIZE:
+      s.rotate.size = strtonum(optarg, 1, LLONG_MAX, &errstr);
+      if (errstr != NULL)
+        errx(2, "strtonum: %s", errstr);
+      break;
+    case OPT_ROTATE_INTERVAL:
+      s.rotate.interval = strtonum(optarg, 1, INT_MAX, &errstr);
+      if (errstr != NULL)
+        errx(2, "strtonum: %s", errstr);
+      break;
+    case OPT_ROTATE_COUNT:
+      s.rotate.count = strtonum(optarg, 1, INT_MAX - 1, &errstr);
+      if (errstr != NULL)
+        errx(2, "strtonum: %s", errstr);
+      break;
+    case OPT_COMPRESS:
+      if (tscatcompression(optarg, &s.compress_level) < 0)
+        errx(2, "invalid option: %s: gzip[:<level>]", optarg);
+      s.compress = 1;
+      break;
+    case OPT_IO:
+      if (strcmp(optarg, "poll") == 0)
+        s.io = TS_IO_POLL;
+      else if (strcmp(optarg, "uring") == 0)
+        s.io = TS_IO_URING;
+      else
+        errx(2, "invalid option: %s: poll|uring", optarg);
+      break;
+    case OPT_REFORMAT:
+      s.reformat = 1;
+      break;
+    case OPT_FROM_FORMAT:
+      s.from_format = optarg;
+      break;
+    case OPT_RATE:
+      if (tscatrate(optarg, &s.rate) < 0)
+        errx(2, "invalid option: %s: <n><lines|bytes>/s[,burst=<n>]",
+             optarg);
       break;
     case 'h':
       usage();
@@ -107,124 +333,778 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  argc -= optind;
-  argv += optind;
+  /* exec: a command follows the "--" ending the options. The process
+   * restrictions are applied after the command is started.
+   *
+   * Without a label, an argument beginning with "-" after "--" is the
+   * label: tscat -- -label
+   */
+  if (optind < argc && strcmp(argv[optind - 1], "--") == 0 &&
+      (label != NULL || argv[optind][0] != '-'))
+    cmd = &argv[optind];
+  else if (label == NULL && optind < argc)
+    label = argv[optind];
+
+  if (label == NULL)
+    label = "";
 
-  s.label = (argc == 0) ? "" : argv[0];
+  if (s.stats_interval > 0 && s.stats_fd == -1)
+    s.stats_fd = STDERR_FILENO;
+
+  /* relative: the elapsed time is formatted as a UTC time: %s is the
+   * elapsed seconds and %T the elapsed hours, minutes and seconds
+   */
+  if (s.relative != TS_RELATIVE_NONE)
+    s.tz.utc = 1;
+
+  /* Initialize timezone before enabling process restrictions: localtime(3)
+   * reads /etc/localtime. UTC timestamps do not use the timezone.
+   */
+  if (!s.tz.utc) {
+    now = time(NULL);
+    if (now == -1)
+      err(EXIT_FAILURE, "time");
+
+    if (tstime_init(&s.tz, now) < 0)
+      err(EXIT_FAILURE, "tstime_init");
+  }
 
   if (s.format == NULL)
-    s.format = "%FT%T%z";
+    s.format = s.relative == TS_RELATIVE_NONE ? "%FT%T%z" : "%s.%6N";
+
+  if (tsformat_compile(&s.fmt, s.format) < 0)
+    err(2, "invalid format: %s", s.format);
+
+  if (clock_gettime(s.clock, &s.start) < 0)
+    err(EXIT_FAILURE, "clock_gettime");
+
+  s.prev = s.start;
+
+  /* decode: binary records are read from stdin */
+  if (s.decode && (s.output_format == TS_OUTPUT_BINARY || s.nin > 0 ||
+                   cmd != NULL || s.threads))
+    errx(2, "--decode: reads stdin and does not support --threads or "
+            "binary output");
+
+  if (s.rate.rate > 0) {
+    struct timespec mono;
+
+    if (s.decode || s.reformat)
+      errx(2, "--rate: not supported with --decode or --reformat");
+
+    if (clock_gettime(CLOCK_MONOTONIC, &mono) < 0)
+      err(EXIT_FAILURE, "clock_gettime");
+
+    tsrate_init(&s.rate, &mono);
+  }
 
-  if ((s.write_error != TS_WR_BLOCK) && (s.output & STDOUT_FILENO) &&
-      (fcntl(fileno(stdout), F_SETFL, O_NONBLOCK) < 0))
-    err(EXIT_FAILURE, "fcntl");
+  /* reformat: stdin is a regular file containing tscat output */
+  if (s.reformat) {
+    struct stat sb;
 
-  if ((s.write_error != TS_WR_BLOCK) && (s.output & STDERR_FILENO) &&
-      (fcntl(fileno(stderr), F_SETFL, O_NONBLOCK) < 0))
-    err(EXIT_FAILURE, "fcntl");
+    if (s.output_format != TS_OUTPUT_TEXT || s.nin > 0 || cmd != NULL ||
+        s.threads || s.decode || s.relative != TS_RELATIVE_NONE ||
+        s.rotate.size > 0 || s.rotate.interval > 0)
+      errx(2, "--reformat: reads stdin and does not support inputs, "
+              "--threads, --relative, rotation or formatted output");
 
-  if (restrict_process_stdin() < 0)
+    if (fstat(STDIN_FILENO, &sb) < 0)
+      err(EXIT_FAILURE, "stdin");
+
+    if (!S_ISREG(sb.st_mode))
+      errx(2, "--reformat: stdin is not a regular file");
+
+    if (s.from_format == NULL)
+      s.from_format = "%FT%T%z";
+
+    if (tsformat_compile(&s.from, s.from_format) < 0)
+      err(2, "invalid format: %s", s.from_format);
+
+    s.io = TS_IO_POLL;
+  }
+
+  if (cmd != NULL) {
+    pid = tscatexec(&s, label, cmd);
+    if (pid < 0)
+      err(EXIT_FAILURE, "%s", cmd[0]);
+  }
+
+  /* The process is restricted before the inputs and the output file are
+   * opened: write access is kept only if required. A process restricted
+   * before the options were parsed drops the unused access.
+   */
+  for (i = 0; i < s.nin; i++) {
+    if (s.in[i].path != NULL)
+      rflags |= RESTRICT_PROCESS_FIFO;
+  }
+
+  if (s.output_file != NULL)
+    rflags |= RESTRICT_PROCESS_FILE;
+
+  if (rflags != rinit && restrict_process_init(rflags) < 0)
+    err(EXIT_FAILURE, "restrict_process_init");
+
+  if (tscatinputs(&s, label) < 0)
+    err(EXIT_FAILURE, "input");
+
+  /* output-file: replaces stdout unless an output is selected by -o */
+  if (s.output_file != NULL) {
+    tsout_t *o;
+
+    if (tsrotate_open(&s.rotate, s.output_file) < 0)
+      err(EXIT_FAILURE, "%s", s.output_file);
+
+    /* binary: a file starts with the magic, an existing file is rotated */
+    if (s.output_format == TS_OUTPUT_BINARY && s.rotate.written > 0 &&
+        tsrotate(&s.rotate) < 0)
+      err(EXIT_FAILURE, "%s", s.output_file);
+
+    o = tscatnewout(&s);
+    if (o == NULL)
+      err(EXIT_FAILURE, "output");
+
+    o->fd = s.rotate.fd;
+    s.nout++;
+
+    if (output == -1)
+      output = 0;
+
+    dir.path = s.rotate.dir;
+    dir.fd = s.rotate.dirfd;
+    dir.flags = TSROTATE_FLAGS;
+
+    if (restrict_process_dir(&dir) < 0)
+      err(EXIT_FAILURE, "restrict_process_dir");
+  }
+
+  if (output != -1)
+    s.output = output;
+
+  /* compress: the compressed outputs block
+   *
+   * reformat: chunks are written in full
+   */
+  if (s.compress && s.write_error != TS_WR_BLOCK &&
+      ((s.output & STDOUT_FILENO) || s.output_file != NULL))
+    errx(2, "--compress: --write-error=drop|exit|queue is not supported");
+
+  if (s.reformat &&
+      (tscatwriteerror(&s, TS_WR_DROP) || tscatwriteerror(&s, TS_WR_EXIT) ||
+       tscatwriteerror(&s, TS_WR_QUEUE)))
+    errx(2, "--reformat: --write-error=drop|exit|queue is not supported");
+
+  /* binary: records are not dropped or replaced by a text marker */
+  if (s.output_format == TS_OUTPUT_BINARY &&
+      (tscatwriteerror(&s, TS_WR_DROP) || tscatwriteerror(&s, TS_WR_QUEUE)))
+    errx(2, "binary: --write-error=drop|queue is not supported");
+
+  if (s.output_format == TS_OUTPUT_BINARY && s.nin > UINT16_MAX)
+    errx(2, "binary: too many inputs");
+
+  if (tscatobuf(&s) < 0)
+    err(EXIT_FAILURE, "malloc");
+
+  if (tscatoutputs(&s) < 0)
+    err(EXIT_FAILURE, "output");
+
+  /* If stdout and stderr are pipes, stderr is duplicated from stdout
+   * without copying.
+   */
+  if (s.output == (STDOUT_FILENO | STDERR_FILENO) &&
+      tsout_tee(&s.out[0], STDERR_FILENO) == 0) {
+    tsout_free(&s.out[1]);
+    (void)memmove(&s.out[1], &s.out[2], (s.nout - 2) * sizeof(tsout_t));
+    s.nout--;
+  }
+
+  /* io: falls back to poll(2) if io_uring is not available */
+  if (s.io == TS_IO_URING && tscaturinginit(&s) < 0)
+    s.io = TS_IO_POLL;
+
+  /* inputs, outputs, any duplicated outputs, the stats descriptors and
+   * the output file directory
+   */
+  fd = calloc(s.nin + s.nout * 2 + 4, sizeof(int));
+  if (fd == NULL)
+    err(EXIT_FAILURE, "calloc");
+
+  for (i = 0; i < s.nin; i++)
+    fd[nfd++] = s.in[i].fd;
+
+  for (i = 0; i < s.nout; i++) {
+    fd[nfd++] = s.out[i].fd;
+    if (s.out[i].dup != -1)
+      fd[nfd++] = s.out[i].dup;
+  }
+
+  /* The writer and stats threads are started before the stdin
+   * restrictions are applied: the restrictions cover all threads.
+   */
+  if (s.stats_fd != -1) {
+    for (i = 0; i < s.nout; i++)
+      s.out[i].timed = 1;
+
+    if (tscatstatsinit(&s) < 0)
+      err(EXIT_FAILURE, "stats");
+
+    fd[nfd++] = s.stats_fd;
+    fd[nfd++] = s.stats_pipe[0];
+    fd[nfd++] = s.stats_pipe[1];
+  }
+
+  if (s.reformat && tscatreformatinit(&s) < 0)
+    err(EXIT_FAILURE, "reformat");
+
+  if (s.threads) {
+    if (tsring_init(&s.ring, s.ring_size) < 0)
+      err(EXIT_FAILURE, "tsring_init");
+
+    errno = pthread_create(&s.writer, NULL, tscatwriter, &s);
+    if (errno != 0)
+      err(EXIT_FAILURE, "pthread_create");
+  }
+
+  if (s.rotate.fd != -1) {
+    if (tsrotate_reserve(&s.rotate) < 0)
+      err(EXIT_FAILURE, "%s", s.output_file);
+
+    dir.spare = s.rotate.spare;
+    fd[nfd++] = s.rotate.dirfd;
+  }
+
+  if (restrict_process_stdin(fd, nfd, s.rotate.fd == -1 ? NULL : &dir) < 0)
     err(EXIT_FAILURE, "restrict_process_stdin");
 
-  if (tscatin(&s) < 0)
+  free(fd);
+
+  if (s.reformat) {
+    if (tscatreformat(&s) < 0)
+      err(EXIT_FAILURE, "reformat");
+  } else if (s.decode) {
+    if (tscatdecode(&s) < 0)
+      err(EXIT_FAILURE, "decode");
+  } else if (tscatin(&s) < 0)
     err(EXIT_FAILURE, "tscatin");
 
+  /* output-file: failures are ignored as when rotating */
+  if (s.rotate.fd != -1)
+    (void)tsrotate_trim(&s.rotate);
+
+  if (s.stats_fd != -1)
+    tscatstats(&s);
+
+  return pid == -1 ? 0 : tscatstatus(pid);
+}
+
+static int tscatclock(const char *arg, clockid_t *clock) {
+  if (strcmp(arg, "realtime") == 0)
+    *clock = CLOCK_REALTIME;
+#if defined(CLOCK_REALTIME_COARSE)
+  else if (strcmp(arg, "realtime_coarse") == 0)
+    *clock = CLOCK_REALTIME_COARSE;
+#elif defined(CLOCK_REALTIME_FAST)
+  else if (strcmp(arg, "realtime_coarse") == 0)
+    *clock = CLOCK_REALTIME_FAST;
+#endif
+  else if (strcmp(arg, "monotonic") == 0)
+    *clock = CLOCK_MONOTONIC;
+#if defined(CLOCK_BOOTTIME)
+  else if (strcmp(arg, "boottime") == 0)
+    *clock = CLOCK_BOOTTIME;
+#endif
+  else
+    return -1;
+
   return 0;
 }
 
-static int tscatin(ts_state_t *s) {
-  char *buf = NULL;
-  size_t buflen = 0;
-  ssize_t n;
+/* gzip[:<level>] */
+static int tscatcompression(const char *arg, int *level) {
+  const char *errstr = NULL;
 
-  while ((n = getnline(&buf, &buflen, 4096, stdin)) != -1) {
-    if (tscatout(s, buf, n) < 0) {
-      if (errno == EAGAIN && s->write_error == TS_WR_DROP)
-        continue;
-      return -1;
+  if (strncmp(arg, "gzip", 4) != 0)
+    return -1;
+
+  *level = -1;
+
+  if (arg[4] == '\0')
+    return 0;
+
+  if (arg[4] != ':')
+    return -1;
+
+  *level = strtonum(arg + 5, 1, 9, &errstr);
+
+  return errstr == NULL ? 0 : -1;
+}
+
+/* Rate limit: <n>[lines|bytes]/s[,burst=<n>]
+ *
+ * The burst defaults to the rate.
+ */
+static int tscatrate(const char *arg, tsrate_t *r) {
+  char *const token[] = {"burst", NULL};
+  const char *errstr = NULL;
+  char *opt;
+  char *p;
+  char *unit;
+  char *value;
+  size_t n;
+
+  /* getsubopt(3) modifies the string */
+  opt = strdup(arg);
+  if (opt == NULL)
+    return -1;
+
+  p = strchr(opt, ',');
+  if (p != NULL)
+    *p++ = '\0';
+
+  n = strspn(opt, "0123456789");
+  unit = opt + n;
+
+  if (strcmp(unit, "/s") == 0 || strcmp(unit, "lines/s") == 0)
+    r->unit = TSRATE_LINES;
+  else if (strcmp(unit, "bytes/s") == 0)
+    r->unit = TSRATE_BYTES;
+  else
+    goto ERR;
+
+  *unit = '\0';
+
+  r->rate = strtonum(opt, 1, UINT32_MAX, &errstr);
+  if (errstr != NULL)
+    goto ERR;
+
+  r->burst = r->rate;
+
+  while (p != NULL && *p != '\0') {
+    switch (getsubopt(&p, token, &value)) {
+    case 0:
+      if (value == NULL)
+        goto ERR;
+      r->burst = strtonum(value, 1, UINT32_MAX, &errstr);
+      if (errstr != NULL)
+        goto ERR;
+      break;
+    default:
+      goto ERR;
+    }
+  }
+
+  free(opt);
+  return 0;
+
+ERR:
+  free(opt);
+  return -1;
+}
+
+/* Add an output: fd=<fd>[,write-error=<policy>]
+ *
+ * The output is initialized by tscatoutputs(). If the write error
+ * behaviour is not set, the behaviour of stdout is used.
+ */
+static int tscatsink(ts_state_t *s, const char *arg) {
+  char *const token[] = {"fd", "write-error", NULL};
+  const char *errstr = NULL;
+  tsout_t *o;
+  char *opt;
+  char *p;
+  char *value;
+
+  o = tscatnewout(s);
+  if (o == NULL)
+    return -1;
+
+  /* getsubopt(3) modifies the string */
+  opt = strdup(arg);
+  if (opt == NULL)
+    return -1;
+
+  for (p = opt; *p != '\0';) {
+    switch (getsubopt(&p, token, &value)) {
+    case 0:
+      if (value == NULL)
+        goto ERR;
+      o->fd = strtonum(value, 1, INT_MAX, &errstr);
+      if (errstr != NULL)
+        goto ERR;
+      break;
+    case 1:
+      if (value == NULL || tscatpolicy(value, &o->write_error, &o->size) < 0)
+        goto ERR;
+      break;
+    default:
+      goto ERR;
     }
   }
 
-  free(buf);
-  if (ferror(stdin))
+  free(opt);
+
+  if (o->fd == -1)
     return -1;
+
+  s->nout++;
   return 0;
+
+ERR:
+  free(opt);
+  return -1;
 }
 
-static int tscatout(ts_state_t *s, char *buf, size_t n) {
-  char timestamp[64] = {0};
-  time_t now;
-  struct tm *tm;
-  int nl;
+/* Returns 1 if any output uses the write error behaviour: stdout, stderr
+ * and sinks without a behaviour use the default.
+ */
+static int tscatwriteerror(const ts_state_t *s, int write_error) {
+  int i;
 
-  if (n == 0)
-    return 0;
+  if (s->output != 0 && s->write_error == write_error)
+    return 1;
+
+  for (i = 0; i < s->nout; i++) {
+    if ((s->out[i].write_error == -1 ? s->write_error
+                                     : s->out[i].write_error) == write_error)
+      return 1;
+  }
 
-  nl = (buf[n - 1] == '\n');
+  return 0;
+}
+
+/* Add an input: fd=<fd>|fifo=<path>[,label=<label>]
+ *
+ * The input is opened by tscatinputs(). The path and label refer to the
+ * copy of the option.
+ */
+static int tscatinput(ts_state_t *s, const char *arg) {
+  char *const token[] = {"fd", "fifo", "label", NULL};
+  const char *errstr = NULL;
+  ts_input_t *in;
+  char *opt;
+  char *p;
+  char *value;
 
-  now = time(NULL);
-  if (now == -1)
+  in = tscatnewinput(s);
+  if (in == NULL)
     return -1;
 
-  tm = localtime(&now);
+  /* getsubopt(3) modifies the string */
+  opt = strdup(arg);
+  if (opt == NULL)
+    return -1;
 
-  /* Linux:
-   * If the length of the result string (including the terminating
-   * null byte) would exceed max bytes, then strftime() returns 0, and the
-   * contents of the array are undefined.
-   *
-   * Note that the return value 0 does not necessarily indicate an error.
-   * For example, in many locales %p yields an empty string.  An  empty
-   * format string will likewise yield an empty string.
-   *
-   * OpenBSD:
-   * Note that while this implementation of strftime() will always NUL
-   * terminate buf, other implementations may not do so when maxsize is not
-   * large enough to store the entire time string.  The contents of buf are
-   * implementation specific in this case.
-   */
-  if (strftime(timestamp, sizeof(timestamp) - 1, s->format, tm) == 0)
-    timestamp[0] = '\0';
+  for (p = opt; *p != '\0';) {
+    switch (getsubopt(&p, token, &value)) {
+    case 0:
+      if (value == NULL)
+        goto ERR;
+      in->fd = strtonum(value, 0, INT_MAX, &errstr);
+      if (errstr != NULL)
+        goto ERR;
+      break;
+    case 1:
+      if (value == NULL || *value == '\0')
+        goto ERR;
+      in->path = value;
+      break;
+    case 2:
+      if (value == NULL)
+        goto ERR;
+      in->label = value;
+      break;
+    default:
+      goto ERR;
+    }
+  }
+
+  if ((in->fd == -1) == (in->path == NULL))
+    goto ERR;
+
+  s->nin++;
+  return 0;
 
-  if (s->print_timestamp) {
-    if (s->output & STDOUT_FILENO)
-      if (fprintf(stdout, "%s%s%s%s", timestamp,
-                  timestamp[0] == '\0' ? "" : " ", s->label,
-                  s->label[0] == '\0' ? "" : " ") < 0)
-        return -1;
+ERR:
+  free(opt);
+  return -1;
+}
 
-    if (s->output & STDERR_FILENO)
-      if (fprintf(stderr, "%s%s%s%s", timestamp,
-                  timestamp[0] == '\0' ? "" : " ", s->label,
-                  s->label[0] == '\0' ? "" : " ") < 0)
-        return -1;
+/* Run a command with stdout and stderr connected to pipes: the pipes are
+ * read as the inputs <label>.out and <label>.err.
+ *
+ * label: defaults to the name of the command
+ */
+static pid_t tscatexec(ts_state_t *s, const char *label, char *argv[]) {
+  const char *stream[] = {"out", "err"};
+  int fd[2][2];
+  pid_t pid;
+  size_t len;
+  char *p;
+  int i;
+
+  if (label[0] == '\0') {
+    p = strrchr(argv[0], '/');
+    label = p == NULL ? argv[0] : p + 1;
+  }
+
+  for (i = 0; i < 2; i++) {
+    if (pipe(fd[i]) < 0)
+      return -1;
+
+    if (fcntl(fd[i][0], F_SETFD, FD_CLOEXEC) < 0)
+      return -1;
+  }
+
+  pid = fork();
+
+  switch (pid) {
+  case -1:
+    return -1;
+  case 0:
+    if (dup2(fd[0][1], STDOUT_FILENO) < 0 ||
+        dup2(fd[1][1], STDERR_FILENO) < 0)
+      _exit(127);
+
+    (void)close(fd[0][1]);
+    (void)close(fd[1][1]);
+
+    (void)execvp(argv[0], argv);
+    warn("%s", argv[0]);
+    _exit(errno == ENOENT ? 127 : 126);
+  default:
+    break;
   }
 
-  if (s->output & STDOUT_FILENO)
-    if (fprintf(stdout, "%s", buf) < 0)
+  for (i = 0; i < 2; i++) {
+    ts_input_t *in;
+
+    (void)close(fd[i][1]);
+
+    in = tscatnewinput(s);
+    if (in == NULL)
       return -1;
 
-  if (s->output & STDERR_FILENO)
-    if (fprintf(stderr, "%s", buf) < 0)
+    in->fd = fd[i][0];
+
+    len = strlen(label) + strlen(stream[i]) + 2;
+    in->label = malloc(len);
+    if (in->label == NULL)
       return -1;
 
-  s->print_timestamp = nl;
+    (void)snprintf(in->label, len, "%s.%s", label, stream[i]);
+
+    s->nin++;
+  }
+
+  return pid;
+}
+
+/* The exit status of the command: a command terminated by a signal
+ * exits with 128 + the signal number.
+ */
+static int tscatstatus(pid_t pid) {
+  int status;
+
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      err(EXIT_FAILURE, "waitpid");
+  }
+
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+
+  return WEXITSTATUS(status);
+}
+
+/* SIGUSR1 is blocked in all threads except for the stats thread: reads
+ * and writes are not interrupted.
+ */
+static int tscatstatsinit(ts_state_t *s) {
+  struct sigaction act = {0};
+  sigset_t set;
+
+  if (pipe(s->stats_pipe) < 0)
+    return -1;
+
+  if (fcntl(s->stats_pipe[1], F_SETFL, O_NONBLOCK) < 0)
+    return -1;
+
+  tscat_stats_signal = s->stats_pipe[1];
+
+  act.sa_handler = tscatsignal;
+  act.sa_flags = SA_RESTART;
+  (void)sigemptyset(&act.sa_mask);
+
+  if (sigaction(SIGUSR1, &act, NULL) < 0)
+    return -1;
+
+  (void)sigemptyset(&set);
+  (void)sigaddset(&set, SIGUSR1);
+
+  errno = pthread_sigmask(SIG_BLOCK, &set, NULL);
+  if (errno != 0)
+    return -1;
+
+  errno = pthread_create(&s->stats_writer, NULL, tscatstatswriter, s);
+  if (errno != 0)
+    return -1;
 
   return 0;
 }
 
+/* Write statistics on SIGUSR1 or when the interval expires. */
+static void *tscatstatswriter(void *arg) {
+  ts_state_t *s = arg;
+  struct pollfd fds = {.fd = s->stats_pipe[0], .events = POLLIN};
+  long long deadline = 0;
+  long long now;
+  sigset_t set;
+  char buf[64];
+  int timeout;
+  int rv;
+
+  (void)sigemptyset(&set);
+  (void)sigaddset(&set, SIGUSR1);
+  (void)pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+  for (;;) {
+    timeout = -1;
+
+    if (s->stats_interval > 0) {
+      now = tscatmsec();
+      if (deadline == 0)
+        deadline = now + s->stats_interval;
+      timeout = deadline > now ? deadline - now : 0;
+    }
+
+    rv = poll(&fds, 1, timeout);
+    if (rv == -1) {
+      if (errno == EINTR)
+        continue;
+      err(EXIT_FAILURE, "poll");
+    }
+
+    if (rv == 0)
+      deadline = 0;
+    else if (read(s->stats_pipe[0], buf, sizeof(buf)) < 0 && errno != EINTR)
+      err(EXIT_FAILURE, "read");
+
+    tscatstats(s);
+  }
+
+  return NULL;
+}
+
+/* Counters are read while being updated by the other threads: each value
+ * is consistent but the summary may not be.
+ */
+static void tscatstats(ts_state_t *s) {
+  char histogram[512];
+  int i;
+
+  (void)dprintf(s->stats_fd, "tscat: stats: lines=%llu bytes=%llu\n",
+                tsstats_get(&s->stats.lines), tsstats_get(&s->stats.bytes));
+
+  if (s->rate.rate > 0)
+    (void)dprintf(s->stats_fd, "tscat: stats: suppressed=%llu\n",
+                  tsstats_get(&s->stats.suppressed));
+
+  for (i = 0; i < s->nout; i++) {
+    tsout_t *o = &s->out[i];
+
+    (void)dprintf(s->stats_fd,
+                  "tscat: stats: fd=%d lines=%llu bytes=%llu eagain=%llu "
+                  "dropped=%llu dropped_bytes=%llu write_us=%llu\n",
+                  o->fd, tsstats_get(&o->stats.lines),
+                  tsstats_get(&o->stats.bytes), tsstats_get(&o->stats.eagain),
+                  tsstats_get(&o->stats.dropped),
+                  tsstats_get(&o->stats.droppedlen),
+                  tsstats_get(&o->stats.write_ns) / 1000);
+  }
+
+  (void)tsstats_histogram(&s->stats, histogram, sizeof(histogram));
+  (void)dprintf(s->stats_fd, "tscat: stats: latency_us %s\n", histogram);
+}
+
+static void tscatsignal(int sig) {
+  int oerrno = errno;
+  char c = 0;
+  ssize_t n;
+
+  (void)sig;
+
+  n = write(tscat_stats_signal, &c, 1);
+  (void)n;
+
+  errno = oerrno;
+}
+
 static void usage(void) {
   (void)fprintf(
       stderr,
-      "%s: [OPTION] [<LABEL>]\n"
-      "Timestamp stdin to stdout/stderr\n"
+      "%s: [OPTION] [<LABEL>] [-- <COMMAND> [<ARG>...]]\n"
+      "Timestamp stdin or the output of a command to stdout/stderr\n"
+      "Arguments after -- are a command: use \"%s <LABEL>\" to label stdin\n"
+      "(\"%s -- -<LABEL>\" if the label begins with -)\n"
       "version: %s (using %s mode process restriction)\n\n"
-      "-o, --output <1|2|3>      stdout=1, stderr=2, both=3 (default: 1)\n"
+      "-o, --output <0|1|2|3>    stdout=1, stderr=2, both=3 (default: 1)\n"
       "-f, --format <fmt>        timestamp format (see strftime(3)) (default: "
       "%%F%%T%%z)\n"
-      "-W, --write-error <exit|drop|block>\n"
+      "                          %%N: nanoseconds, %%3N: milliseconds, "
+      "%%6N: microseconds\n"
+      "-u, --utc                 timestamps in UTC\n"
+      "-z, --null                records are terminated by NUL, not newline\n"
+      "--delimiter <char>        records are terminated by a character\n"
+      "                          (default: newline)\n"
+      "--clock <realtime|realtime_coarse|monotonic|boottime>\n"
+      "                          clock used for timestamps (default: "
+      "realtime)\n"
+      "--relative <start|prev>   timestamp is the time elapsed since start or\n"
+      "                          since the previous line (default format:\n"
+      "                          %%s.%%6N)\n"
+      "-W, --write-error <exit|drop|block|queue=<bytes>>\n"
       "                          behaviour if write buffer is full (default: "
       "block)\n"
+      "--flush <line|batch|<ms>>\n"
+      "                          flush output after every line, when input is\n"
+      "                          idle or after an interval (default: batch\n"
+      "                          for regular files, otherwise line)\n"
+      "--sink fd=<fd>[,write-error=<exit|drop|block|queue=<bytes>>]\n"
+      "                          also write to an inherited descriptor\n"
+      "--output-file <path>      write to a file instead of stdout\n"
+      "--rotate-size <bytes>     rotate the output file at a size\n"
+      "--rotate-interval <s>     rotate the output file periodically\n"
+      "--rotate-count <n>        rotated output files kept (default: 5)\n"
+      "--compress <gzip[:<level>]>\n"
+      "                          compress stdout and the output file\n"
+      "--input fd=<fd>|fifo=<path>[,label=<label>]\n"
+      "                          read from a descriptor or FIFO instead of "
+      "stdin\n"
+      "--stats[=<fd>]            write statistics on exit and on SIGUSR1\n"
+      "                          (default: 2)\n"
+      "--stats-interval <ms>     write statistics periodically\n"
+      "--output-format <text|json|logfmt|binary>\n"
+      "                          format of the output (default: text)\n"
+      "--decode                  read binary records from stdin\n"
+      "--reformat                replace the timestamps of tscat output\n"
+      "                          read from stdin (a regular file)\n"
+      "--from-format <fmt>       timestamp format of the input to\n"
+      "                          --reformat (default: %%FT%%T%%z)\n"
+      "--rate <n><lines|bytes>/s[,burst=<n>]\n"
+      "                          discard lines exceeding a rate\n"
+      "--max-line <bytes|unlimited>\n"
+      "                          maximum line length (default: 4096)\n"
+      "--long-line <stream|split|truncate>\n"
+      "                          behaviour if a line exceeds the maximum "
+      "length\n"
+      "                          (default: stream)\n"
+      "--pipe-size <bytes>       Linux: size of input and output pipes, 0 to\n"
+      "                          leave unchanged (default: 1048576)\n"
+      "--buffer-size <bytes>     output buffer size (default: 131072, regular\n"
+      "                          files: 1048576)\n"
+      "--threads[=<size>]        read and write using separate threads with a\n"
+      "                          queue of size bytes (default: 1048576)\n"
+      "--io <poll|uring>         Linux: read and write using io_uring\n"
+      "                          (default: poll)\n"
       "-h, --help                usage summary\n",
-      __progname, TS_VERSION, RESTRICT_PROCESS);
+      __progname, __progname, __progname, TS_VERSION, RESTRICT_PROCESS);
 }
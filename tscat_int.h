@@ -0,0 +1,168 @@
+/* Internal interface shared by the library and the tscat command: the
+ * state is not part of the library API (libtscat.h).
+ */
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "getnline.h"
+#include "libtscat.h"
+#include "tsformat.h"
+#include "tsout.h"
+#include "tsrate.h"
+#include "tsrotate.h"
+#include "tstime.h"
+#include "tsreformat.h"
+#include "tsuring.h"
+
+enum { TS_FLUSH_LINE = 0, TS_FLUSH_BATCH, TS_FLUSH_INTERVAL, TS_FLUSH_AUTO };
+
+enum { TS_LONG_STREAM = 0, TS_LONG_SPLIT, TS_LONG_TRUNCATE };
+
+enum { TS_RELATIVE_NONE = 0, TS_RELATIVE_START, TS_RELATIVE_PREV };
+
+enum { TS_OUTPUT_TEXT = 0, TS_OUTPUT_JSON, TS_OUTPUT_LOGFMT, TS_OUTPUT_BINARY };
+
+enum { TS_IO_POLL = 0, TS_IO_URING };
+
+/* An input: lines from each input are timestamped and labeled
+ * independently.
+ *
+ * midline: reader, the last record queued did not end the line
+ * suppress: reader, the line is discarded by the rate limit
+ * print_timestamp: writer, the next record starts a line
+ */
+typedef struct {
+  int fd;
+  char *path;
+  char *label;
+  size_t labellen;
+  getnline_t r;
+  int ready;
+  int midline;
+  int suppress;
+  size_t linelen;
+  int print_timestamp;
+} ts_input_t;
+
+/* The state shared by the tscat command and library streams */
+typedef struct tscat {
+  int output;
+  char *format;
+  tsformat_t fmt;
+  int write_error;
+  size_t queue_size;
+  int flush;
+  int flush_interval;
+  long long flush_deadline;
+  ts_input_t *in;
+  int nin;
+  int active;
+  ts_input_t *owner;
+  long long owner_deadline;
+  tsout_t *out;
+  int nout;
+  struct pollfd *fds;
+  int pipe_size;
+  size_t buffer_size;
+  int threads;
+  size_t ring_size;
+  tsring_t ring;
+  pthread_t writer;
+  int stats_fd;
+  int stats_interval;
+  int stats_pipe[2];
+  pthread_t stats_writer;
+  tsstats_t stats;
+  int delim;
+  size_t max_line;
+  int long_line;
+  clockid_t clock;
+  int relative;
+  struct timespec start;
+  struct timespec prev;
+  int output_format;
+  char *obuf;
+  int binhdr;
+  int decode;
+  ts_input_t *labels;
+  int nlabel;
+  const char *output_file;
+  tsrotate_t rotate;
+  int compress;
+  int compress_level;
+  int io;
+  tsrate_t rate;
+  ts_input_t *limited;
+  int reformat;
+  const char *from_format;
+  tsformat_t from;
+  tsreformat_t rf;
+  char *map;
+  size_t maplen;
+  tsuring_t uring;
+  struct iovec *uiov;
+  int udefer;
+  int uread;
+  int uresult;
+  char prefix[64 + 1];
+  size_t prefixlen;
+  time_t prefixtime;
+  tstime_t tz;
+  struct tm tm;
+  time_t tmtime;
+} ts_state_t;
+
+/* Set the defaults for the tscat command and library streams. */
+void tscatdefaults(ts_state_t *s);
+
+/* Parse a write error policy: block, drop, exit or queue=<bytes>. The
+ * queue size is only set for queue. Returns -1 if the policy is invalid.
+ */
+int tscatpolicy(const char *arg, int *write_error, size_t *size);
+
+/* Allocate an output. The output is added by incrementing s->nout. */
+tsout_t *tscatnewout(ts_state_t *s);
+
+/* Initialize the outputs selected by s->output and the sinks: buffering,
+ * flush mode and compression. Returns -1 with errno set on error.
+ */
+int tscatoutputs(ts_state_t *s);
+
+/* Allocate an input. The input is added by incrementing s->nin. */
+ts_input_t *tscatnewinput(ts_state_t *s);
+
+/* Open the inputs: stdin if no inputs were added. label: the label of
+ * any input without a label.
+ */
+int tscatinputs(ts_state_t *s, const char *label);
+
+/* Allocate the buffer of formatted records. Called after the outputs and
+ * inputs are added.
+ */
+int tscatobuf(ts_state_t *s);
+
+/* Timestamp the inputs until all inputs are closed. Returns -1 with
+ * errno set on error.
+ */
+int tscatin(ts_state_t *s);
+
+/* --decode: convert binary records read from stdin. */
+int tscatdecode(ts_state_t *s);
+
+/* --threads: the writer thread started with pthread_create(3). */
+void *tscatwriter(void *arg);
+
+/* io: set up io_uring for the inputs and outputs. Returns -1 if io_uring
+ * is not available.
+ */
+int tscaturinginit(ts_state_t *s);
+
+/* --reformat: map stdin and start the workers. */
+int tscatreformatinit(ts_state_t *s);
+
+/* --reformat: write the reformatted chunks to the outputs. */
+int tscatreformat(ts_state_t *s);
+
+/* The monotonic clock in milliseconds or 0 on error. */
+long long tscatmsec(void);
@@ -0,0 +1,289 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tscompress.h"
+
+#ifdef TSCAT_COMPRESS_zlib
+#include <zlib.h>
+
+/* Records in the queue: data is followed by a flush. An end record
+ * completes the gzip stream and starts a new stream.
+ *
+ * The ring returns 0 for a closed ring: the end record has a 1 byte
+ * payload that is not compressed.
+ */
+enum { TSCOMPRESS_DATA = 0, TSCOMPRESS_FLUSH, TSCOMPRESS_END };
+
+static void *tscompress_run(void *arg);
+static int tscompress_deflate(tscompress_t *z, char *buf, size_t n,
+                              int flush);
+static int tscompress_write(tscompress_t *z);
+
+/* level: 1-9 or -1 for the default compression level */
+int tscompress_init(tscompress_t *z, int fd, int level) {
+  z_stream *zs;
+
+  (void)memset(z, 0, sizeof(*z));
+
+  z->fd = fd;
+
+  z->buf = malloc(TSCOMPRESS_BUFSIZ);
+  zs = calloc(1, sizeof(z_stream));
+  if (z->buf == NULL || zs == NULL)
+    return -1;
+
+  z->stream = zs;
+
+  /* gzip format */
+  if (deflateInit2(zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (tsring_init(&z->ring, TSRING_SIZE) < 0)
+    return -1;
+
+  if (pthread_mutex_init(&z->lock, NULL) != 0 ||
+      pthread_cond_init(&z->cond, NULL) != 0)
+    return -1;
+
+  errno = pthread_create(&z->thread, NULL, tscompress_run, z);
+  if (errno != 0)
+    return -1;
+
+  return 0;
+}
+
+/* Queue data for compression. The data is flushed after the last
+ * iovec: the queue blocks when full.
+ *
+ * Returns the number of bytes queued or -1 if a previous write failed.
+ */
+ssize_t tscompress_writev(tscompress_t *z, const struct iovec *iov,
+                          int iovcnt) {
+  const struct timespec ts = {0};
+  ssize_t n = 0;
+  int i;
+
+  if (atomic_load(&z->error) != 0) {
+    errno = atomic_load(&z->error);
+    return -1;
+  }
+
+  for (i = 0; i < iovcnt; i++) {
+    const char *p = iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+
+    while (len > 0) {
+      size_t m = len < TSCOMPRESS_BUFSIZ ? len : TSCOMPRESS_BUFSIZ;
+      int tag = (i == iovcnt - 1 && m == len) ? TSCOMPRESS_FLUSH
+                                              : TSCOMPRESS_DATA;
+
+      if (tsring_put(&z->ring, &ts, tag, p, m) < 0)
+        return -1;
+
+      p += m;
+      len -= m;
+      n += m;
+    }
+  }
+
+  return n;
+}
+
+/* Complete the gzip stream and wait until the stream is written. */
+int tscompress_end(tscompress_t *z) {
+  const struct timespec ts = {0};
+  unsigned long ends;
+
+  (void)pthread_mutex_lock(&z->lock);
+  ends = z->ends;
+  (void)pthread_mutex_unlock(&z->lock);
+
+  if (tsring_put(&z->ring, &ts, TSCOMPRESS_END, "", 1) < 0)
+    return -1;
+
+  (void)pthread_mutex_lock(&z->lock);
+  while (z->ends == ends)
+    (void)pthread_cond_wait(&z->cond, &z->lock);
+  (void)pthread_mutex_unlock(&z->lock);
+
+  if (atomic_load(&z->error) != 0) {
+    errno = atomic_load(&z->error);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Complete the gzip stream and stop the thread. */
+int tscompress_close(tscompress_t *z) {
+  const struct timespec ts = {0};
+  int rv = 0;
+
+  if (tsring_put(&z->ring, &ts, TSCOMPRESS_END, "", 1) < 0)
+    rv = -1;
+
+  tsring_close(&z->ring);
+
+  errno = pthread_join(z->thread, NULL);
+  if (errno != 0)
+    return -1;
+
+  (void)deflateEnd(z->stream);
+  free(z->stream);
+  free(z->buf);
+  tsring_free(&z->ring);
+
+  if (atomic_load(&z->error) != 0) {
+    errno = atomic_load(&z->error);
+    return -1;
+  }
+
+  return rv;
+}
+
+/* If a write fails, queued data is discarded: the error is returned by
+ * the next write.
+ */
+static void *tscompress_run(void *arg) {
+  tscompress_t *z = arg;
+  struct timespec ts;
+  char *buf;
+  ssize_t n;
+  int tag;
+
+  while ((n = tsring_get(&z->ring, &ts, &tag, &buf, -1)) != 0) {
+    if (n < 0)
+      continue;
+
+    if (tag == TSCOMPRESS_END)
+      n = 0;
+
+    if (atomic_load(&z->error) == 0 &&
+        tscompress_deflate(z, buf, n,
+                           tag == TSCOMPRESS_DATA    ? Z_NO_FLUSH
+                           : tag == TSCOMPRESS_FLUSH ? Z_SYNC_FLUSH
+                                                     : Z_FINISH) < 0)
+      atomic_store(&z->error, errno == 0 ? EIO : errno);
+
+    tsring_pop(&z->ring);
+
+    if (tag == TSCOMPRESS_END) {
+      (void)deflateReset(z->stream);
+
+      (void)pthread_mutex_lock(&z->lock);
+      z->ends++;
+      (void)pthread_cond_broadcast(&z->cond);
+      (void)pthread_mutex_unlock(&z->lock);
+    }
+  }
+
+  return NULL;
+}
+
+/* Compressed data is written when the buffer is full or flushed. */
+static int tscompress_deflate(tscompress_t *z, char *buf, size_t n,
+                              int flush) {
+  z_stream *zs = z->stream;
+
+  zs->next_in = (Bytef *)buf;
+  zs->avail_in = n;
+
+  for (;;) {
+    zs->next_out = (Bytef *)z->buf + z->len;
+    zs->avail_out = TSCOMPRESS_BUFSIZ - z->len;
+
+    if (deflate(zs, flush) == Z_STREAM_ERROR) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    z->len = TSCOMPRESS_BUFSIZ - zs->avail_out;
+
+    if (zs->avail_out == 0) {
+      if (tscompress_write(z) < 0)
+        return -1;
+      continue;
+    }
+
+    if (zs->avail_in == 0)
+      break;
+  }
+
+  if (flush == Z_NO_FLUSH)
+    return 0;
+
+  return tscompress_write(z);
+}
+
+static int tscompress_write(tscompress_t *z) {
+  struct pollfd fds = {.fd = z->fd, .events = POLLOUT};
+  size_t off = 0;
+  ssize_t n;
+
+  while (off < z->len) {
+    n = write(z->fd, z->buf + off, z->len - off);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      /* the output may be non-blocking */
+      if (errno == EAGAIN && poll(&fds, 1, -1) >= 0)
+        continue;
+      return -1;
+    }
+    off += n;
+  }
+
+  z->len = 0;
+  return 0;
+}
+#else
+int tscompress_init(tscompress_t *z, int fd, int level) {
+  (void)z;
+  (void)fd;
+  (void)level;
+  errno = ENOTSUP;
+  return -1;
+}
+
+ssize_t tscompress_writev(tscompress_t *z, const struct iovec *iov,
+                          int iovcnt) {
+  (void)z;
+  (void)iov;
+  (void)iovcnt;
+  errno = ENOTSUP;
+  return -1;
+}
+
+int tscompress_end(tscompress_t *z) {
+  (void)z;
+  errno = ENOTSUP;
+  return -1;
+}
+
+int tscompress_close(tscompress_t *z) {
+  (void)z;
+  errno = ENOTSUP;
+  return -1;
+}
+#endif
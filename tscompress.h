@@ -0,0 +1,31 @@
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "tsring.h"
+
+#define TSCOMPRESS_BUFSIZ 65536
+
+/* Compressed output: data is queued and compressed by a thread.
+ *
+ * Each write is compressed and flushed as a unit: if the process exits
+ * unexpectedly, data up to the last completed write can be recovered.
+ */
+typedef struct {
+  int fd;
+  tsring_t ring;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned long ends;
+  atomic_int error;
+  void *stream;
+  char *buf;
+  size_t len;
+} tscompress_t;
+
+int tscompress_init(tscompress_t *z, int fd, int level);
+ssize_t tscompress_writev(tscompress_t *z, const struct iovec *iov,
+                          int iovcnt);
+int tscompress_end(tscompress_t *z);
+int tscompress_close(tscompress_t *z);
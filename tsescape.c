@@ -0,0 +1,193 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tsescape.h"
+
+static size_t tsescape_clean(const unsigned char *s, size_t n);
+static size_t tsescape_utf8(const unsigned char *s, size_t n);
+
+static const char hex[] = "0123456789abcdef";
+
+/* Escape bytes for use in a JSON string.
+ *
+ * Runs of printable ASCII are copied as is. Quotes, backslashes and
+ * control characters are escaped. Valid UTF-8 sequences are copied and
+ * each byte of an invalid sequence is replaced by U+FFFD.
+ *
+ * dst: at least TSESCAPE_MAX(n) bytes
+ *
+ * Returns the number of bytes written to dst.
+ */
+size_t tsescape_json(char *dst, const char *src, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  char *p = dst;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t run = tsescape_clean(s + i, n - i);
+    size_t len;
+
+    (void)memcpy(p, s + i, run);
+    p += run;
+    i += run;
+
+    if (i == n)
+      break;
+
+    switch (s[i]) {
+    case '"':
+    case '\\':
+      *p++ = '\\';
+      *p++ = s[i];
+      break;
+    case '\n':
+      *p++ = '\\';
+      *p++ = 'n';
+      break;
+    case '\r':
+      *p++ = '\\';
+      *p++ = 'r';
+      break;
+    case '\t':
+      *p++ = '\\';
+      *p++ = 't';
+      break;
+    default:
+      if (s[i] < 0x20) {
+        (void)memcpy(p, "\\u00", 4);
+        p[4] = hex[s[i] >> 4];
+        p[5] = hex[s[i] & 0xf];
+        p += 6;
+        break;
+      }
+
+      len = tsescape_utf8(s + i, n - i);
+      if (len == 0) {
+        (void)memcpy(p, "\\ufffd", 6);
+        p += 6;
+        break;
+      }
+
+      (void)memcpy(p, s + i, len);
+      p += len;
+      i += len;
+      continue;
+    }
+
+    i++;
+  }
+
+  return p - dst;
+}
+
+/* logfmt: a value may be written without quotes if it is not empty and
+ * contains only printable ASCII other than space, '=' and '"'.
+ */
+int tsescape_bare(const char *src, size_t n) {
+  size_t i;
+
+  if (n == 0)
+    return 0;
+
+  for (i = 0; i < n; i++) {
+    unsigned char c = src[i];
+
+    if (c <= ' ' || c >= 0x7f || c == '=' || c == '"' || c == '\\')
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Length of the leading run of bytes that can be copied without escaping:
+ * anything other than quotes, backslashes, control characters and bytes
+ * outside of ASCII.
+ */
+static size_t tsescape_clean(const unsigned char *s, size_t n) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(' ');
+
+  /* Signed comparison: bytes outside of ASCII are negative and compare as
+   * less than a space.
+   */
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmplt_epi8(v, space));
+    int mask = _mm_movemask_epi8(m);
+
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (s[i] < ' ' || s[i] >= 0x80 || s[i] == '"' || s[i] == '\\')
+      break;
+  }
+
+  return i;
+}
+
+/* Length of the UTF-8 sequence at the start of s or 0 if the sequence is
+ * not valid: overlong encodings, surrogates and code points above
+ * U+10FFFF are rejected.
+ */
+static size_t tsescape_utf8(const unsigned char *s, size_t n) {
+  size_t len;
+  unsigned char lo = 0x80;
+  unsigned char hi = 0xbf;
+  size_t i;
+
+  if (s[0] >= 0xc2 && s[0] <= 0xdf)
+    len = 2;
+  else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+    len = 3;
+    if (s[0] == 0xe0)
+      lo = 0xa0;
+    else if (s[0] == 0xed)
+      hi = 0x9f;
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    len = 4;
+    if (s[0] == 0xf0)
+      lo = 0x90;
+    else if (s[0] == 0xf4)
+      hi = 0x8f;
+  } else
+    return 0;
+
+  if (n < len)
+    return 0;
+
+  if (s[1] < lo || s[1] > hi)
+    return 0;
+
+  for (i = 2; i < len; i++) {
+    if (s[i] < 0x80 || s[i] > 0xbf)
+      return 0;
+  }
+
+  return len;
+}
@@ -0,0 +1,9 @@
+#include <stddef.h>
+
+/* Maximum length of n escaped bytes: a control character is escaped as
+ * \u00XX.
+ */
+#define TSESCAPE_MAX(n) ((n) * 6)
+
+size_t tsescape_json(char *dst, const char *src, size_t n);
+int tsescape_bare(const char *src, size_t n);
@@ -0,0 +1,478 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tsformat.h"
+
+static const char digits2[] = "00010203040506070809"
+                              "10111213141516171819"
+                              "20212223242526272829"
+                              "30313233343536373839"
+                              "40414243444546474849"
+                              "50515253545556575859"
+                              "60616263646566676869"
+                              "70717273747576777879"
+                              "80818283848586878889"
+                              "90919293949596979899";
+
+static const long nsec_div[] = {1,         10,         100,      1000,
+                                10000,     100000,     1000000,  10000000,
+                                100000000, 1000000000};
+
+static tsformat_op_t *tsformat_push(tsformat_t *f, int op, const char *str,
+                                    size_t len);
+static size_t tsformat_uint(char *buf, unsigned long long v, int width);
+static int tsformat_digits(const char **p, const char *end, int width,
+                           long long *v);
+static int tsformat_field(const char **p, const char *end, int min, int max,
+                          int *v);
+static int tsformat_strptime(const tsformat_op_t *op, const char **p,
+                             const char *end, struct tm *tm);
+
+/* Compile a strftime(3) format into a list of operations.
+ *
+ * The common conversions are rendered directly from the broken down time.
+ * Sub-second conversions (%N, %3N, %6N, %9N) are rendered from the
+ * timespec. Any other conversion is passed to strftime(3).
+ *
+ * Literals point into fmt: the format string must remain valid for the
+ * lifetime of the compiled format.
+ */
+int tsformat_compile(tsformat_t *f, const char *fmt) {
+  const char *p;
+  size_t len;
+
+  (void)memset(f, 0, sizeof(*f));
+
+  /* %F expands to 5 operations */
+  len = strlen(fmt);
+  f->op = calloc(len * 3 + 1, sizeof(tsformat_op_t));
+  if (f->op == NULL)
+    return -1;
+
+  for (p = fmt; *p != '\0';) {
+    const char *q;
+    int plain = 1;
+    int width = 0;
+
+    if (*p != '%') {
+      q = strchr(p, '%');
+      if (q == NULL)
+        q = p + strlen(p);
+      (void)tsformat_push(f, TSFORMAT_LITERAL, p, q - p);
+      p = q;
+      continue;
+    }
+
+    q = p + 1;
+
+    for (; *q != '\0' && strchr("-_0^#+", *q) != NULL; q++)
+      plain = 0;
+
+    for (; *q >= '0' && *q <= '9'; q++)
+      width = width * 10 + (*q - '0');
+
+    for (; *q == 'E' || *q == 'O'; q++)
+      plain = 0;
+
+    if (*q == '\0') {
+      (void)tsformat_push(f, TSFORMAT_LITERAL, p, q - p);
+      p = q;
+      continue;
+    }
+
+    if (*q == 'N' && plain && width <= 9) {
+      tsformat_op_t *op = tsformat_push(f, TSFORMAT_NSEC, p, q - p + 1);
+      op->width = width == 0 ? 9 : width;
+      f->subsecond = 1;
+      p = q + 1;
+      continue;
+    }
+
+    if (plain && width == 0) {
+      switch (*q) {
+      case '%':
+        (void)tsformat_push(f, TSFORMAT_LITERAL, q, 1);
+        p = q + 1;
+        continue;
+      case 'n':
+        (void)tsformat_push(f, TSFORMAT_LITERAL, "\n", 1);
+        p = q + 1;
+        continue;
+      case 't':
+        (void)tsformat_push(f, TSFORMAT_LITERAL, "\t", 1);
+        p = q + 1;
+        continue;
+      case 'F':
+        (void)tsformat_push(f, TSFORMAT_YEAR, "%Y", 2);
+        (void)tsformat_push(f, TSFORMAT_LITERAL, "-", 1);
+        (void)tsformat_push(f, TSFORMAT_MONTH, "%m", 2);
+        (void)tsformat_push(f, TSFORMAT_LITERAL, "-", 1);
+        (void)tsformat_push(f, TSFORMAT_DAY, "%d", 2);
+        p = q + 1;
+        continue;
+      case 'T':
+        (void)tsformat_push(f, TSFORMAT_HOUR, "%H", 2);
+        (void)tsformat_push(f, TSFORMAT_LITERAL, ":", 1);
+        (void)tsformat_push(f, TSFORMAT_MINUTE, "%M", 2);
+        (void)tsformat_push(f, TSFORMAT_LITERAL, ":", 1);
+        (void)tsformat_push(f, TSFORMAT_SECOND, "%S", 2);
+        p = q + 1;
+        continue;
+      case 'Y':
+        (void)tsformat_push(f, TSFORMAT_YEAR, p, 2);
+        p = q + 1;
+        continue;
+      case 'm':
+        (void)tsformat_push(f, TSFORMAT_MONTH, p, 2);
+        p = q + 1;
+        continue;
+      case 'd':
+        (void)tsformat_push(f, TSFORMAT_DAY, p, 2);
+        p = q + 1;
+        continue;
+      case 'H':
+        (void)tsformat_push(f, TSFORMAT_HOUR, p, 2);
+        p = q + 1;
+        continue;
+      case 'M':
+        (void)tsformat_push(f, TSFORMAT_MINUTE, p, 2);
+        p = q + 1;
+        continue;
+      case 'S':
+        (void)tsformat_push(f, TSFORMAT_SECOND, p, 2);
+        p = q + 1;
+        continue;
+      case 's':
+        (void)tsformat_push(f, TSFORMAT_EPOCH, p, 2);
+        p = q + 1;
+        continue;
+      case 'z':
+        (void)tsformat_push(f, TSFORMAT_OFFSET, p, 2);
+        p = q + 1;
+        continue;
+      default:
+        break;
+      }
+    }
+
+    if ((size_t)(q - p + 1) >= sizeof(f->op[0].spec)) {
+      tsformat_free(f);
+      errno = EINVAL;
+      return -1;
+    }
+
+    (void)tsformat_push(f, TSFORMAT_STRFTIME, p, q - p + 1);
+    p = q + 1;
+  }
+
+  return 0;
+}
+
+void tsformat_free(tsformat_t *f) {
+  free(f->op);
+  f->op = NULL;
+  f->nop = 0;
+}
+
+static tsformat_op_t *tsformat_push(tsformat_t *f, int op, const char *str,
+                                    size_t len) {
+  tsformat_op_t *o = &f->op[f->nop++];
+
+  o->op = op;
+  o->str = str;
+  o->len = len;
+
+  if (op != TSFORMAT_LITERAL && len < sizeof(o->spec))
+    (void)memcpy(o->spec, str, len);
+
+  return o;
+}
+
+/* Render the timestamp into buf.
+ *
+ * Returns the length of the result, not including the terminating NUL, or
+ * 0 if the result does not fit into size bytes.
+ */
+size_t tsformat_render(const tsformat_t *f, const struct timespec *ts,
+                       const struct tm *tm, char *buf, size_t size) {
+  char tmp[64];
+  size_t n = 0;
+  size_t i;
+
+  for (i = 0; i < f->nop; i++) {
+    const tsformat_op_t *op = &f->op[i];
+    const char *str = tmp;
+    size_t len = 0;
+    long v;
+
+    switch (op->op) {
+    case TSFORMAT_LITERAL:
+      str = op->str;
+      len = op->len;
+      break;
+    case TSFORMAT_YEAR:
+      v = tm->tm_year + 1900L;
+      if (v >= 1000 && v <= 9999)
+        len = tsformat_uint(tmp, v, 4);
+      else
+        len = strftime(tmp, sizeof(tmp), op->spec, tm);
+      break;
+    case TSFORMAT_MONTH:
+      len = tsformat_uint(tmp, tm->tm_mon + 1, 2);
+      break;
+    case TSFORMAT_DAY:
+      len = tsformat_uint(tmp, tm->tm_mday, 2);
+      break;
+    case TSFORMAT_HOUR:
+      len = tsformat_uint(tmp, tm->tm_hour, 2);
+      break;
+    case TSFORMAT_MINUTE:
+      len = tsformat_uint(tmp, tm->tm_min, 2);
+      break;
+    case TSFORMAT_SECOND:
+      len = tsformat_uint(tmp, tm->tm_sec, 2);
+      break;
+    case TSFORMAT_EPOCH:
+      if (ts->tv_sec < 0) {
+        tmp[0] = '-';
+        len = 1 + tsformat_uint(tmp + 1, -(long long)ts->tv_sec, 0);
+      } else
+        len = tsformat_uint(tmp, ts->tv_sec, 0);
+      break;
+    case TSFORMAT_OFFSET:
+      v = tm->tm_gmtoff;
+      tmp[0] = v < 0 ? '-' : '+';
+      if (v < 0)
+        v = -v;
+      len = 1 + tsformat_uint(tmp + 1, v / 3600, 2);
+      len += tsformat_uint(tmp + len, (v / 60) % 60, 2);
+      break;
+    case TSFORMAT_NSEC:
+      len = tsformat_uint(tmp, ts->tv_nsec / nsec_div[9 - op->width],
+                          op->width);
+      break;
+    case TSFORMAT_STRFTIME:
+    default:
+      len = strftime(tmp, sizeof(tmp), op->spec, tm);
+      break;
+    }
+
+    if (n + len >= size)
+      return 0;
+
+    (void)memcpy(buf + n, str, len);
+    n += len;
+  }
+
+  if (size > 0)
+    buf[n] = '\0';
+
+  return n;
+}
+
+/* Parse a timestamp rendered using the format.
+ *
+ * The time is the epoch seconds (%s) if present, otherwise the broken
+ * down time at the UTC offset (%z) or, without an offset, in UTC or in
+ * local time. Conversions passed to strftime(3) are parsed by
+ * strptime(3).
+ *
+ * Returns the length of the timestamp or -1 if buf does not start with a
+ * timestamp in the format.
+ */
+ssize_t tsformat_parse(const tsformat_t *f, const char *buf, size_t n,
+                       int utc, struct timespec *ts) {
+  const char *p = buf;
+  const char *end = buf + n;
+  struct tm tm = {0};
+  long long epoch = 0;
+  long long off = 0;
+  int seconds = 0;
+  int offset = 0;
+  long long v;
+  size_t i;
+
+  tm.tm_year = 70;
+  tm.tm_mday = 1;
+  ts->tv_nsec = 0;
+
+  for (i = 0; i < f->nop; i++) {
+    const tsformat_op_t *op = &f->op[i];
+    int sign = 1;
+
+    switch (op->op) {
+    case TSFORMAT_LITERAL:
+      if ((size_t)(end - p) < op->len || memcmp(p, op->str, op->len) != 0)
+        return -1;
+      p += op->len;
+      break;
+    case TSFORMAT_YEAR:
+      if (tsformat_digits(&p, end, 4, &v) < 0)
+        return -1;
+      tm.tm_year = v - 1900;
+      break;
+    case TSFORMAT_MONTH:
+      if (tsformat_field(&p, end, 1, 12, &tm.tm_mon) < 0)
+        return -1;
+      tm.tm_mon--;
+      break;
+    case TSFORMAT_DAY:
+      if (tsformat_field(&p, end, 1, 31, &tm.tm_mday) < 0)
+        return -1;
+      break;
+    case TSFORMAT_HOUR:
+      if (tsformat_field(&p, end, 0, 23, &tm.tm_hour) < 0)
+        return -1;
+      break;
+    case TSFORMAT_MINUTE:
+      if (tsformat_field(&p, end, 0, 59, &tm.tm_min) < 0)
+        return -1;
+      break;
+    case TSFORMAT_SECOND:
+      if (tsformat_field(&p, end, 0, 60, &tm.tm_sec) < 0)
+        return -1;
+      break;
+    case TSFORMAT_EPOCH:
+      if (p < end && *p == '-') {
+        sign = -1;
+        p++;
+      }
+      if (tsformat_digits(&p, end, 0, &epoch) < 0)
+        return -1;
+      epoch *= sign;
+      seconds = 1;
+      break;
+    case TSFORMAT_OFFSET:
+      if (p == end || (*p != '+' && *p != '-'))
+        return -1;
+      sign = *p++ == '-' ? -1 : 1;
+      if (tsformat_digits(&p, end, 4, &v) < 0)
+        return -1;
+      off = sign * ((v / 100) * 3600 + (v % 100) * 60);
+      offset = 1;
+      break;
+    case TSFORMAT_NSEC:
+      if (tsformat_digits(&p, end, op->width, &v) < 0)
+        return -1;
+      ts->tv_nsec = v * nsec_div[9 - op->width];
+      break;
+    case TSFORMAT_STRFTIME:
+    default:
+      if (tsformat_strptime(op, &p, end, &tm) < 0)
+        return -1;
+      break;
+    }
+  }
+
+  if (seconds)
+    ts->tv_sec = epoch;
+  else if (offset)
+    ts->tv_sec = timegm(&tm) - off;
+  else if (utc)
+    ts->tv_sec = timegm(&tm);
+  else {
+    tm.tm_isdst = -1;
+    ts->tv_sec = mktime(&tm);
+  }
+
+  return p - buf;
+}
+
+/* Write v as decimal digits, zero padded to width. */
+static size_t tsformat_uint(char *buf, unsigned long long v, int width) {
+  char tmp[24];
+  char *p = tmp + sizeof(tmp);
+  size_t len;
+
+  while (v >= 100) {
+    p -= 2;
+    (void)memcpy(p, digits2 + (v % 100) * 2, 2);
+    v /= 100;
+  }
+
+  if (v >= 10) {
+    p -= 2;
+    (void)memcpy(p, digits2 + v * 2, 2);
+  } else
+    *--p = '0' + v;
+
+  while (tmp + sizeof(tmp) - p < width)
+    *--p = '0';
+
+  len = tmp + sizeof(tmp) - p;
+  (void)memcpy(buf, p, len);
+
+  return len;
+}
+
+/* Read exactly width decimal digits or, if width is 0, 1 to 18 digits. */
+static int tsformat_digits(const char **p, const char *end, int width,
+                           long long *v) {
+  int max = width == 0 ? 18 : width;
+  int i;
+
+  *v = 0;
+
+  for (i = 0; i < max && *p < end && **p >= '0' && **p <= '9'; i++) {
+    *v = *v * 10 + (**p - '0');
+    (*p)++;
+  }
+
+  if (i == 0 || (width > 0 && i < width))
+    return -1;
+
+  return 0;
+}
+
+/* A 2 digit field of the broken down time */
+static int tsformat_field(const char **p, const char *end, int min, int max,
+                          int *v) {
+  long long n;
+
+  if (tsformat_digits(p, end, 2, &n) < 0 || n < min || n > max)
+    return -1;
+
+  *v = n;
+  return 0;
+}
+
+/* strptime(3) requires a NUL terminated string: a conversion is parsed
+ * from a copy of the start of the input.
+ */
+static int tsformat_strptime(const tsformat_op_t *op, const char **p,
+                             const char *end, struct tm *tm) {
+  char tmp[64];
+  size_t n = end - *p;
+  char *q;
+
+  if (n > sizeof(tmp) - 1)
+    n = sizeof(tmp) - 1;
+
+  (void)memcpy(tmp, *p, n);
+  tmp[n] = '\0';
+
+  q = strptime(tmp, op->spec, tm);
+  if (q == NULL)
+    return -1;
+
+  *p += q - tmp;
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include <sys/types.h>
+#include <time.h>
+
+enum {
+  TSFORMAT_LITERAL = 0,
+  TSFORMAT_STRFTIME,
+  TSFORMAT_YEAR,
+  TSFORMAT_MONTH,
+  TSFORMAT_DAY,
+  TSFORMAT_HOUR,
+  TSFORMAT_MINUTE,
+  TSFORMAT_SECOND,
+  TSFORMAT_EPOCH,
+  TSFORMAT_OFFSET,
+  TSFORMAT_NSEC,
+};
+
+typedef struct {
+  int op;
+  int width;
+  const char *str;
+  size_t len;
+  char spec[16];
+} tsformat_op_t;
+
+typedef struct {
+  tsformat_op_t *op;
+  size_t nop;
+  int subsecond;
+} tsformat_t;
+
+int tsformat_compile(tsformat_t *f, const char *fmt);
+void tsformat_free(tsformat_t *f);
+size_t tsformat_render(const tsformat_t *f, const struct timespec *ts,
+                       const struct tm *tm, char *buf, size_t size);
+ssize_t tsformat_parse(const tsformat_t *f, const char *buf, size_t n,
+                       int utc, struct timespec *ts);
@@ -0,0 +1,601 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tsout.h"
+
+/* Smaller writes to a duplicated output are written twice: staging a
+ * record in the internal pipe costs more than the copy.
+ */
+#define TSOUT_TEE_MIN (PIPE_BUF / 2)
+
+static ssize_t tsout_writev(tsout_t *o, const struct iovec *iov, int iovcnt);
+static ssize_t tsout_dowritev(tsout_t *o, const struct iovec *iov,
+                              int iovcnt);
+#ifdef __linux__
+static int tsout_dupwritev(tsout_t *o, const struct iovec *iov, int iovcnt,
+                           size_t n);
+static ssize_t tsout_unstage(tsout_t *o, size_t n);
+#endif
+static int tsout_discard(tsout_t *o, size_t n);
+static int tsout_error(tsout_t *o);
+static void tsout_append(tsout_t *o, const struct iovec *iov, int iovcnt,
+                         size_t skip);
+static int tsout_drop(tsout_t *o, size_t n);
+static size_t tsout_line(const tsout_t *o, size_t pos);
+static void tsout_marker(tsout_t *o);
+static int tsout_partial(const tsout_t *o, const struct iovec *iov,
+                         int iovcnt);
+
+int tsout_init(tsout_t *o, int fd, int write_error, size_t size) {
+  struct stat sb;
+
+  (void)memset(o, 0, sizeof(*o));
+  o->dup = -1;
+  o->stage[0] = -1;
+  o->stage[1] = -1;
+
+  if (size == 0)
+    size = TSOUT_BUFSIZ;
+
+  if (fstat(fd, &sb) < 0)
+    return -1;
+
+  o->buf = malloc(size);
+  if (o->buf == NULL)
+    return -1;
+
+  o->fd = fd;
+  o->fdflags = -1;
+  o->write_error = write_error;
+  o->size = size;
+  o->delim = '\n';
+
+  /* Writes of up to PIPE_BUF bytes to a pipe are atomic: batches are
+   * limited to PIPE_BUF bytes so a record is never split by another
+   * writer. Records larger than PIPE_BUF are written by themselves.
+   */
+  o->atomic = S_ISFIFO(sb.st_mode) ? PIPE_BUF : size;
+
+  /* queue: the buffer may be large but batches are not, except when
+   * writing to regular files
+   */
+  if (o->atomic > TSOUT_BUFSIZ && !S_ISREG(sb.st_mode))
+    o->atomic = TSOUT_BUFSIZ;
+
+  return 0;
+}
+
+void tsout_free(tsout_t *o) {
+  free(o->buf);
+  o->buf = NULL;
+  o->size = 0;
+
+  if (o->stage[0] != -1) {
+    (void)close(o->stage[0]);
+    (void)close(o->stage[1]);
+    o->stage[0] = -1;
+    o->stage[1] = -1;
+  }
+}
+
+/* Duplicate the output to a second pipe.
+ *
+ * Linux: batches and large records are written once to an internal
+ * pipe, copied to the output with tee(2) and moved to the second pipe
+ * with splice(2): the second copy never passes through userspace.
+ * Smaller writes are written to both outputs.
+ *
+ * Both the output and fd must be blocking pipes. Returns -1 if the
+ * duplicate cannot be made, in which case the caller should write each
+ * output separately.
+ */
+int tsout_tee(tsout_t *o, int fd) {
+#ifdef __linux__
+  struct stat sb;
+
+  if (o->write_error != TS_WR_BLOCK || o->atomic != PIPE_BUF || o->z != NULL)
+    return -1;
+
+  if (fstat(fd, &sb) < 0 || !S_ISFIFO(sb.st_mode))
+    return -1;
+
+  if (pipe2(o->stage, O_CLOEXEC) < 0)
+    return -1;
+
+  /* tee(2) and splice(2) block on the outputs, not the internal pipe */
+  if (fcntl(o->stage[1], F_SETFL, O_NONBLOCK) < 0) {
+    (void)close(o->stage[0]);
+    (void)close(o->stage[1]);
+    o->stage[0] = -1;
+    o->stage[1] = -1;
+    return -1;
+  }
+
+  (void)fcntl(o->stage[1], F_SETPIPE_SZ, (int)o->size);
+
+  o->dup = fd;
+
+  return 0;
+#else
+  (void)o;
+  (void)fd;
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+/* Write a record.
+ *
+ * If flush is set, the record is written immediately with writev(2).
+ * Otherwise the record is appended to the buffer and written when the
+ * buffer is full or the buffer is flushed.
+ *
+ * queue: if the output would block, the record is queued in the buffer
+ * and the output is marked as blocked. Nothing is written to a blocked
+ * output until tsout_flush() is called. If the buffer is full, the oldest
+ * records are discarded.
+ *
+ * Returns 0 if the record was written or buffered. If the record was
+ * discarded because the output would block, returns -1 with errno set
+ * to EAGAIN.
+ */
+int tsout_write(tsout_t *o, const struct iovec *iov, int iovcnt, int flush) {
+  size_t n = 0;
+  ssize_t w;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    n += iov[i].iov_len;
+
+  tsstats_add(&o->stats.lines, 1);
+  tsstats_add(&o->stats.bytes, n);
+
+  if (o->len > 0 && !o->blocked && (flush || o->len + n > o->atomic) &&
+      tsout_flush(o) < 0 && tsout_error(o) < 0)
+    return -1;
+
+  if (flush && o->len == 0) {
+    do {
+      w = tsout_writev(o, iov, iovcnt);
+    } while (w == -1 && errno == EINTR);
+
+    if (w == -1) {
+      if (errno != EAGAIN)
+        return -1;
+      if (o->write_error != TS_WR_QUEUE)
+        return tsout_discard(o, n);
+      o->blocked = 1;
+    } else if ((size_t)w == n) {
+      o->partial = tsout_partial(o, iov, iovcnt);
+      return 0;
+    } else {
+      /* Partial write: the remainder of the record is always written. */
+      o->partial = 1;
+      tsout_append(o, iov, iovcnt, w);
+      return tsout_flush(o) < 0 ? tsout_error(o) : 0;
+    }
+  } else if (flush && o->write_error != TS_WR_QUEUE) {
+    return tsout_discard(o, n);
+  }
+
+  if (o->len + n > o->size) {
+    if (!o->blocked && tsout_flush(o) < 0 && tsout_error(o) < 0)
+      return -1;
+
+    if (o->len + n > o->size) {
+      if (o->write_error != TS_WR_QUEUE)
+        return tsout_discard(o, n);
+
+      if (tsout_drop(o, n) < 0) {
+        o->dropped++;
+        o->droppedlen += n;
+        tsstats_add(&o->stats.dropped, 1);
+        tsstats_add(&o->stats.droppedlen, n);
+        return 0;
+      }
+    }
+  }
+
+  tsout_append(o, iov, iovcnt, 0);
+  return 0;
+}
+
+/* Write a block of records larger than the buffer: any buffered data is
+ * written first. The output must block: the block is written in full.
+ */
+int tsout_writeall(tsout_t *o, const char *buf, size_t n,
+                   unsigned long long lines) {
+  struct iovec iov;
+  ssize_t w;
+
+  if (tsout_flush(o) < 0)
+    return -1;
+
+  tsstats_add(&o->stats.lines, lines);
+  tsstats_add(&o->stats.bytes, n);
+
+  while (n > 0) {
+    iov.iov_base = (char *)buf;
+    iov.iov_len = n;
+
+    w = tsout_writev(o, &iov, 1);
+    if (w == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    buf += w;
+    n -= w;
+  }
+
+  return 0;
+}
+
+/* Write any buffered data.
+ *
+ * Returns 0 if the buffer is empty or -1 if an error occurred. If the
+ * output would block, returns -1 with errno set to EAGAIN and the
+ * remaining data stays in the buffer.
+ *
+ * queue: once the buffer is empty, a line reporting any discarded records
+ * is written.
+ */
+int tsout_flush(tsout_t *o) {
+  struct iovec iov[2];
+  ssize_t n;
+  int iovcnt;
+
+  for (;;) {
+    while ((iovcnt = tsout_pending(o, iov)) > 0) {
+      n = tsout_writev(o, iov, iovcnt);
+      if (n == -1 && errno == EINTR)
+        continue;
+
+      if (tsout_written(o, n) < 0)
+        return -1;
+    }
+
+    o->blocked = 0;
+
+    if (o->dropped == 0 || o->partial)
+      return 0;
+
+    tsout_marker(o);
+  }
+}
+
+/* The buffered data: the buffer is a ring, the data may wrap.
+ *
+ * Returns the number of iovecs or 0 if the buffer is empty.
+ */
+int tsout_pending(const tsout_t *o, struct iovec iov[2]) {
+  if (o->len == 0)
+    return 0;
+
+  iov[0].iov_base = o->buf + o->off;
+  iov[0].iov_len = o->size - o->off < o->len ? o->size - o->off : o->len;
+  iov[1].iov_base = o->buf;
+  iov[1].iov_len = o->len - iov[0].iov_len;
+
+  return iov[1].iov_len > 0 ? 2 : 1;
+}
+
+/* Remove n bytes of written data from the buffer.
+ *
+ * n: the result of writing the pending data, -1 with errno set on error
+ */
+int tsout_written(tsout_t *o, ssize_t n) {
+  if (n == -1) {
+    if (errno == EAGAIN && o->write_error == TS_WR_QUEUE)
+      o->blocked = 1;
+    return -1;
+  }
+
+  o->off = (o->off + n) % o->size;
+  o->len -= n;
+  o->partial = o->buf[(o->off + o->size - 1) % o->size] != o->delim;
+
+  return 0;
+}
+
+/* Count the time spent in write(2) and the number of times the output
+ * would have blocked.
+ */
+static ssize_t tsout_writev(tsout_t *o, const struct iovec *iov, int iovcnt) {
+  struct timespec start;
+  struct timespec end;
+  ssize_t n;
+
+  if (!o->timed) {
+    n = tsout_dowritev(o, iov, iovcnt);
+  } else {
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    n = tsout_dowritev(o, iov, iovcnt);
+    (void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+    tsstats_add(&o->stats.write_ns,
+                (end.tv_sec - start.tv_sec) * 1000000000LL +
+                    (end.tv_nsec - start.tv_nsec));
+  }
+
+  if (n == -1 && errno == EAGAIN)
+    tsstats_add(&o->stats.eagain, 1);
+
+  return n;
+}
+
+static ssize_t tsout_dowritev(tsout_t *o, const struct iovec *iov,
+                              int iovcnt) {
+#ifdef __linux__
+  ssize_t n;
+  ssize_t staged;
+  size_t len = 0;
+  int i;
+
+  if (o->z != NULL)
+    return tscompress_writev(o->z, iov, iovcnt);
+
+  if (o->dup == -1)
+    return writev(o->fd, iov, iovcnt);
+
+  for (i = 0; i < iovcnt; i++)
+    len += iov[i].iov_len;
+
+  if (len < TSOUT_TEE_MIN) {
+    n = writev(o->fd, iov, iovcnt);
+    if (n > 0 && tsout_dupwritev(o, iov, iovcnt, n) < 0)
+      return -1;
+    return n;
+  }
+
+  /* The internal pipe is empty: a partial write means the pipe is full. */
+  staged = writev(o->stage[1], iov, iovcnt);
+  if (staged == -1)
+    return -1;
+
+  for (n = staged; n > 0;) {
+    ssize_t t;
+    ssize_t m;
+
+    t = tee(o->stage[0], o->fd, n, 0);
+    if (t == -1) {
+      if (errno == EINTR)
+        continue;
+      return tsout_unstage(o, n);
+    }
+
+    while (t > 0) {
+      m = splice(o->stage[0], NULL, o->dup, NULL, t, SPLICE_F_MOVE);
+      if (m == -1) {
+        if (errno == EINTR)
+          continue;
+        return tsout_unstage(o, n);
+      }
+      t -= m;
+      n -= m;
+    }
+  }
+
+  return staged;
+#else
+  if (o->z != NULL)
+    return tscompress_writev(o->z, iov, iovcnt);
+
+  return writev(o->fd, iov, iovcnt);
+#endif
+}
+
+#ifdef __linux__
+/* Write the first n bytes of a record to the duplicate output. */
+static int tsout_dupwritev(tsout_t *o, const struct iovec *iov, int iovcnt,
+                           size_t n) {
+  int i;
+
+  for (i = 0; i < iovcnt && n > 0; i++) {
+    const char *p = iov[i].iov_base;
+    size_t len = iov[i].iov_len < n ? iov[i].iov_len : n;
+
+    n -= len;
+
+    while (len > 0) {
+      ssize_t w = write(o->dup, p, len);
+      if (w == -1) {
+        if (errno == EINTR)
+          continue;
+        return -1;
+      }
+      p += w;
+      len -= w;
+    }
+  }
+
+  return 0;
+}
+
+/* Discard n bytes left in the internal pipe after an error: the data
+ * is not written again with the next record.
+ */
+static ssize_t tsout_unstage(tsout_t *o, size_t n) {
+  char buf[PIPE_BUF];
+  int errnum = errno;
+
+  while (n > 0) {
+    ssize_t r = read(o->stage[0], buf, n < sizeof(buf) ? n : sizeof(buf));
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    n -= r;
+  }
+
+  errno = errnum;
+  return -1;
+}
+#endif
+
+/* A blocked output is an error if the write error behaviour is exit. */
+static int tsout_error(tsout_t *o) {
+  if (errno != EAGAIN || o->write_error == TS_WR_EXIT)
+    return -1;
+
+  return 0;
+}
+
+static void tsout_append(tsout_t *o, const struct iovec *iov, int iovcnt,
+                         size_t skip) {
+  int i;
+
+  if (o->len == 0)
+    o->off = 0;
+
+  for (i = 0; i < iovcnt; i++) {
+    const char *p = (const char *)iov[i].iov_base + skip;
+    size_t len = iov[i].iov_len;
+    size_t end;
+    size_t m;
+
+    if (skip >= len) {
+      skip -= len;
+      continue;
+    }
+
+    len -= skip;
+    skip = 0;
+
+    /* the buffer is a ring: the record may wrap */
+    end = (o->off + o->len) % o->size;
+    m = o->size - end < len ? o->size - end : len;
+
+    (void)memcpy(o->buf + end, p, m);
+    (void)memcpy(o->buf, p + m, len - m);
+    o->len += len;
+  }
+}
+
+/* Discard the oldest records until n bytes are free.
+ *
+ * A record is a line. The remainder of a partially written line is never
+ * discarded: the oldest complete lines following it are removed instead.
+ *
+ * Returns -1 if n bytes cannot be made available.
+ */
+static int tsout_drop(tsout_t *o, size_t n) {
+  size_t keep = 0;
+  size_t skip;
+  size_t i;
+
+  if (o->partial)
+    keep = tsout_line(o, 0);
+
+  if (n > o->size - keep)
+    return -1;
+
+  for (skip = keep; o->size - o->len + (skip - keep) < n;) {
+    size_t m = tsout_line(o, skip);
+
+    o->dropped++;
+    o->droppedlen += m;
+    tsstats_add(&o->stats.dropped, 1);
+    tsstats_add(&o->stats.droppedlen, m);
+    skip += m;
+  }
+
+  /* Move the remainder of the partially written line up to the first
+   * record that was kept.
+   */
+  for (i = keep; i > 0; i--)
+    o->buf[(o->off + skip - keep + i - 1) % o->size] =
+        o->buf[(o->off + i - 1) % o->size];
+
+  o->off = (o->off + skip - keep) % o->size;
+  o->len -= skip - keep;
+
+  return 0;
+}
+
+/* Length of the buffered line starting at pos, including the delimiter. */
+static size_t tsout_line(const tsout_t *o, size_t pos) {
+  size_t start = (o->off + pos) % o->size;
+  size_t len = o->len - pos;
+  size_t m = o->size - start < len ? o->size - start : len;
+  const char *p;
+
+  p = memchr(o->buf + start, o->delim, m);
+  if (p != NULL)
+    return p - (o->buf + start) + 1;
+
+  p = memchr(o->buf, o->delim, len - m);
+  if (p != NULL)
+    return m + (p - o->buf) + 1;
+
+  return len;
+}
+
+static void tsout_marker(tsout_t *o) {
+  char buf[TSOUT_MARKERSIZ];
+  struct iovec iov;
+  int n;
+
+  if (o->marker != NULL)
+    n = o->marker(o->arg, buf, sizeof(buf), o->dropped, o->droppedlen);
+  else
+    n = snprintf(buf, sizeof(buf), "tscat: dropped %zu lines (%zu bytes)%c",
+                 o->dropped, o->droppedlen, o->delim);
+
+  o->dropped = 0;
+  o->droppedlen = 0;
+
+  if (n < 0 || (size_t)n >= sizeof(buf))
+    return;
+
+  iov.iov_base = buf;
+  iov.iov_len = n;
+  tsout_append(o, &iov, 1, 0);
+}
+
+/* The record was discarded because the output would block. */
+static int tsout_discard(tsout_t *o, size_t n) {
+  tsstats_add(&o->stats.dropped, 1);
+  tsstats_add(&o->stats.droppedlen, n);
+
+  errno = EAGAIN;
+  return -1;
+}
+
+/* The record does not end with the delimiter. */
+static int tsout_partial(const tsout_t *o, const struct iovec *iov,
+                         int iovcnt) {
+  int i;
+
+  for (i = iovcnt - 1; i >= 0; i--) {
+    if (iov[i].iov_len > 0)
+      return ((const char *)iov[i].iov_base)[iov[i].iov_len - 1] != o->delim;
+  }
+
+  return 0;
+}
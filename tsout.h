@@ -0,0 +1,59 @@
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "tscompress.h"
+#include "tsstats.h"
+
+#define TSOUT_BUFSIZ 131072
+#define TSOUT_MARKERSIZ 2048
+
+enum { TS_WR_BLOCK = 0, TS_WR_DROP, TS_WR_EXIT, TS_WR_QUEUE };
+
+/* Format the count of dropped records as a record of the output format.
+ * Returns the length of the record in buf or -1 to discard the count.
+ */
+typedef int (*tsout_marker_t)(void *arg, char *buf, size_t size,
+                              size_t dropped, size_t droppedlen);
+
+typedef struct {
+  tsstats_counter_t lines;
+  tsstats_counter_t bytes;
+  tsstats_counter_t eagain;
+  tsstats_counter_t dropped;
+  tsstats_counter_t droppedlen;
+  tsstats_counter_t write_ns;
+} tsout_stats_t;
+
+typedef struct {
+  int fd;
+  int fdflags;
+  int write_error;
+  char *buf;
+  size_t size;
+  size_t off;
+  size_t len;
+  size_t atomic;
+  int blocked;
+  int partial;
+  size_t dropped;
+  size_t droppedlen;
+  int timed;
+  int flush;
+  int delim;
+  tsout_stats_t stats;
+  int dup;
+  int stage[2];
+  tscompress_t *z;
+  tsout_marker_t marker;
+  void *arg;
+} tsout_t;
+
+int tsout_init(tsout_t *o, int fd, int write_error, size_t size);
+void tsout_free(tsout_t *o);
+int tsout_tee(tsout_t *o, int fd);
+int tsout_write(tsout_t *o, const struct iovec *iov, int iovcnt, int flush);
+int tsout_writeall(tsout_t *o, const char *buf, size_t n,
+                   unsigned long long lines);
+int tsout_flush(tsout_t *o);
+int tsout_pending(const tsout_t *o, struct iovec iov[2]);
+int tsout_written(tsout_t *o, ssize_t n);
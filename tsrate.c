@@ -0,0 +1,88 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <stddef.h>
+
+#include "tsrate.h"
+
+#define TSRATE_NSEC 1000000000ULL
+
+static unsigned long long tsrate_cost(const tsrate_t *r, size_t n);
+static void tsrate_spend(tsrate_t *r, unsigned long long cost);
+
+/* The bucket starts full. */
+void tsrate_init(tsrate_t *r, const struct timespec *now) {
+  r->tokens = r->burst * TSRATE_NSEC;
+  r->last = *now;
+  r->suppressed = 0;
+}
+
+void tsrate_refill(tsrate_t *r, const struct timespec *now) {
+  unsigned long long max = r->burst * TSRATE_NSEC;
+  unsigned long long ns;
+
+  if (now->tv_sec < r->last.tv_sec ||
+      (now->tv_sec == r->last.tv_sec && now->tv_nsec <= r->last.tv_nsec))
+    return;
+
+  ns = (unsigned long long)(now->tv_sec - r->last.tv_sec) * TSRATE_NSEC +
+       now->tv_nsec - r->last.tv_nsec;
+
+  r->last = *now;
+
+  /* the bucket fills before the elapsed time would overflow */
+  if (ns > (max - r->tokens) / r->rate)
+    r->tokens = max;
+  else
+    r->tokens += ns * r->rate;
+}
+
+/* Take the tokens for the start of a line of n bytes.
+ *
+ * Returns 1 if the line is admitted or 0 if the bucket does not hold
+ * enough tokens. A line longer than the burst is admitted when the
+ * bucket is full.
+ */
+int tsrate_take(tsrate_t *r, size_t n) {
+  unsigned long long cost = tsrate_cost(r, n);
+
+  if (r->tokens < (cost < r->burst ? cost : r->burst) * TSRATE_NSEC)
+    return 0;
+
+  tsrate_spend(r, cost);
+  return 1;
+}
+
+/* Charge the rest of an admitted line: in bytes, the remaining n bytes
+ * empty the bucket if the line is longer than the tokens held.
+ */
+void tsrate_charge(tsrate_t *r, size_t n) {
+  if (r->unit == TSRATE_BYTES)
+    tsrate_spend(r, n);
+}
+
+/* Milliseconds since the first line suppressed in the interval */
+long long tsrate_elapsed(const tsrate_t *r, const struct timespec *now) {
+  return (now->tv_sec - r->since.tv_sec) * 1000LL +
+         (now->tv_nsec - r->since.tv_nsec) / 1000000;
+}
+
+static unsigned long long tsrate_cost(const tsrate_t *r, size_t n) {
+  return r->unit == TSRATE_BYTES ? n : 1;
+}
+
+static void tsrate_spend(tsrate_t *r, unsigned long long cost) {
+  cost *= TSRATE_NSEC;
+  r->tokens = cost < r->tokens ? r->tokens - cost : 0;
+}
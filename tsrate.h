@@ -0,0 +1,26 @@
+#include <time.h>
+
+enum { TSRATE_LINES = 0, TSRATE_BYTES };
+
+/* Token bucket: the bucket holds up to burst tokens and is refilled at
+ * rate tokens per second. A token is a line or a byte.
+ *
+ * Tokens are counted in billionths: a refill of less than a token is
+ * kept.
+ */
+typedef struct {
+  int unit;
+  unsigned long long rate;
+  unsigned long long burst;
+  unsigned long long tokens;
+  struct timespec last;
+  /* lines suppressed in the current interval */
+  unsigned long long suppressed;
+  struct timespec since;
+} tsrate_t;
+
+void tsrate_init(tsrate_t *r, const struct timespec *now);
+void tsrate_refill(tsrate_t *r, const struct timespec *now);
+int tsrate_take(tsrate_t *r, size_t n);
+void tsrate_charge(tsrate_t *r, size_t n);
+long long tsrate_elapsed(const tsrate_t *r, const struct timespec *now);
@@ -0,0 +1,267 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tsformat.h"
+#include "tstime.h"
+#include "tsreformat.h"
+
+/* Maximum length of a rendered timestamp */
+#define TSREFORMAT_PREFIX 64
+
+static void *tsreformat_run(void *arg);
+static void tsreformat_assign(tsreformat_t *r, tsreformat_chunk_t *c);
+static int tsreformat_chunk(tsreformat_t *r, tsreformat_chunk_t *c);
+
+/* The workers are started idle: threads are created before the process
+ * restrictions are applied.
+ */
+int tsreformat_init(tsreformat_t *r, const tsformat_t *from,
+                    const tsformat_t *to, const tstime_t *tz, int delim,
+                    int nthread) {
+  int i;
+
+  (void)memset(r, 0, sizeof(*r));
+
+  r->from = from;
+  r->to = to;
+  r->tz = tz;
+  r->delim = delim;
+  r->prev = -1;
+
+  r->chunk = calloc(nthread, sizeof(tsreformat_chunk_t));
+  if (r->chunk == NULL)
+    return -1;
+
+  if (pthread_mutex_init(&r->lock, NULL) != 0 ||
+      pthread_cond_init(&r->cond, NULL) != 0)
+    return -1;
+
+  for (i = 0; i < nthread; i++) {
+    tsreformat_chunk_t *c = &r->chunk[i];
+
+    c->r = r;
+
+    errno = pthread_create(&c->thread, NULL, tsreformat_run, c);
+    if (errno != 0)
+      return -1;
+
+    r->nchunk++;
+  }
+
+  return 0;
+}
+
+/* Start reformatting the input: a chunk is assigned to each worker. */
+void tsreformat_input(tsreformat_t *r, const char *in, size_t inlen) {
+  int i;
+
+  (void)pthread_mutex_lock(&r->lock);
+
+  r->in = in;
+  r->inlen = inlen;
+
+  for (i = 0; i < r->nchunk; i++)
+    tsreformat_assign(r, &r->chunk[i]);
+
+  (void)pthread_cond_broadcast(&r->cond);
+  (void)pthread_mutex_unlock(&r->lock);
+}
+
+/* Wait for the next chunk of output.
+ *
+ * The output is valid until the next call: the worker is then assigned
+ * the next chunk of input.
+ *
+ * Returns 1 if a chunk was returned, 0 if no input remains or -1 if the
+ * chunk could not be reformatted.
+ */
+int tsreformat_next(tsreformat_t *r, const char **buf, size_t *len,
+                    unsigned long long *lines) {
+  tsreformat_chunk_t *c = &r->chunk[r->next];
+  int rv = 1;
+
+  (void)pthread_mutex_lock(&r->lock);
+
+  if (r->prev != -1) {
+    tsreformat_assign(r, &r->chunk[r->prev]);
+    (void)pthread_cond_broadcast(&r->cond);
+    r->prev = -1;
+  }
+
+  while (c->state == TSREFORMAT_BUSY)
+    (void)pthread_cond_wait(&r->cond, &r->lock);
+
+  if (c->state == TSREFORMAT_IDLE) {
+    rv = 0;
+  } else if (c->error != 0) {
+    errno = c->error;
+    rv = -1;
+  } else {
+    *buf = c->buf;
+    *len = c->len;
+    *lines = c->lines;
+
+    c->state = TSREFORMAT_IDLE;
+    r->prev = r->next;
+    r->next = (r->next + 1) % r->nchunk;
+  }
+
+  (void)pthread_mutex_unlock(&r->lock);
+
+  return rv;
+}
+
+void tsreformat_free(tsreformat_t *r) {
+  int i;
+
+  (void)pthread_mutex_lock(&r->lock);
+  r->stop = 1;
+  (void)pthread_cond_broadcast(&r->cond);
+  (void)pthread_mutex_unlock(&r->lock);
+
+  for (i = 0; i < r->nchunk; i++) {
+    (void)pthread_join(r->chunk[i].thread, NULL);
+    free(r->chunk[i].buf);
+  }
+
+  free(r->chunk);
+  r->chunk = NULL;
+  r->nchunk = 0;
+}
+
+static void *tsreformat_run(void *arg) {
+  tsreformat_chunk_t *c = arg;
+  tsreformat_t *r = c->r;
+  int error;
+
+  (void)pthread_mutex_lock(&r->lock);
+
+  for (;;) {
+    while (c->state != TSREFORMAT_BUSY && !r->stop)
+      (void)pthread_cond_wait(&r->cond, &r->lock);
+
+    if (r->stop)
+      break;
+
+    (void)pthread_mutex_unlock(&r->lock);
+    error = tsreformat_chunk(r, c) < 0 ? errno : 0;
+    (void)pthread_mutex_lock(&r->lock);
+
+    c->error = error;
+    c->state = TSREFORMAT_DONE;
+    (void)pthread_cond_broadcast(&r->cond);
+  }
+
+  (void)pthread_mutex_unlock(&r->lock);
+
+  return NULL;
+}
+
+/* Assign the next chunk of input, extended to the end of the line. The
+ * lock is held.
+ */
+static void tsreformat_assign(tsreformat_t *r, tsreformat_chunk_t *c) {
+  size_t len = r->inlen - r->off;
+  const char *p;
+
+  if (len == 0)
+    return;
+
+  if (len > TSREFORMAT_CHUNK) {
+    p = memchr(r->in + r->off + TSREFORMAT_CHUNK, r->delim,
+               len - TSREFORMAT_CHUNK);
+    if (p != NULL)
+      len = p - (r->in + r->off) + 1;
+  }
+
+  c->in = r->in + r->off;
+  c->inlen = len;
+  c->state = TSREFORMAT_BUSY;
+
+  r->off += len;
+}
+
+/* Replace the timestamp at the start of each line. Lines not starting
+ * with a timestamp followed by a space are copied unchanged.
+ */
+static int tsreformat_chunk(tsreformat_t *r, tsreformat_chunk_t *c) {
+  const char *p = c->in;
+  const char *end = c->in + c->inlen;
+  char prefix[TSREFORMAT_PREFIX + 1];
+  size_t prefixlen = 0;
+  time_t prefixtime = -1;
+  struct timespec ts;
+  struct tm tm;
+
+  c->len = 0;
+  c->lines = 0;
+
+  while (p < end) {
+    const char *q = memchr(p, r->delim, end - p);
+    size_t n = q == NULL ? (size_t)(end - p) : (size_t)(q - p) + 1;
+    ssize_t m = tsformat_parse(r->from, p, n, r->tz->utc, &ts);
+    size_t plen = 0;
+
+    if (m > 0 && (size_t)m < n && p[m] == ' ') {
+      m++;
+
+      /* Without sub-second conversions, the rendered timestamp is reused
+       * until the second changes.
+       */
+      if (r->to->subsecond || ts.tv_sec != prefixtime) {
+        if (tstime_localtime(r->tz, ts.tv_sec, &tm) == NULL)
+          return -1;
+
+        prefixlen =
+            tsformat_render(r->to, &ts, &tm, prefix, sizeof(prefix) - 1);
+        if (prefixlen > 0)
+          prefix[prefixlen++] = ' ';
+
+        prefixtime = ts.tv_sec;
+      }
+
+      plen = prefixlen;
+    } else {
+      m = 0;
+    }
+
+    if (c->len + plen + n - m > c->size) {
+      size_t size = c->size == 0 ? c->inlen + c->inlen / 4 : c->size * 2;
+      char *buf;
+
+      if (size < c->len + plen + n - m)
+        size = c->len + plen + n - m;
+
+      buf = realloc(c->buf, size);
+      if (buf == NULL)
+        return -1;
+
+      c->buf = buf;
+      c->size = size;
+    }
+
+    (void)memcpy(c->buf + c->len, prefix, plen);
+    (void)memcpy(c->buf + c->len + plen, p + m, n - m);
+    c->len += plen + n - m;
+    c->lines++;
+
+    p += n;
+  }
+
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include <pthread.h>
+#include <sys/types.h>
+
+/* Chunks of input processed by each worker */
+#define TSREFORMAT_CHUNK (8 * 1024 * 1024)
+
+enum {
+  TSREFORMAT_IDLE = 0,
+  TSREFORMAT_BUSY,
+  TSREFORMAT_DONE,
+};
+
+struct tsreformat;
+
+typedef struct {
+  struct tsreformat *r;
+  pthread_t thread;
+  int state;
+  const char *in;
+  size_t inlen;
+  char *buf;
+  size_t len;
+  size_t size;
+  unsigned long long lines;
+  int error;
+} tsreformat_chunk_t;
+
+/* Reformat the timestamps of tscat output using worker threads.
+ *
+ * The input is split into line aligned chunks. Each worker reformats a
+ * chunk into its own buffer: chunks are returned in input order.
+ */
+typedef struct tsreformat {
+  const tsformat_t *from;
+  const tsformat_t *to;
+  const tstime_t *tz;
+  int delim;
+  const char *in;
+  size_t inlen;
+  size_t off;
+  tsreformat_chunk_t *chunk;
+  int nchunk;
+  int next;
+  int prev;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} tsreformat_t;
+
+int tsreformat_init(tsreformat_t *r, const tsformat_t *from,
+                    const tsformat_t *to, const tstime_t *tz, int delim,
+                    int nthread);
+void tsreformat_input(tsreformat_t *r, const char *in, size_t inlen);
+int tsreformat_next(tsreformat_t *r, const char **buf, size_t *len,
+                    unsigned long long *lines);
+void tsreformat_free(tsreformat_t *r);
@@ -0,0 +1,245 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tsring.h"
+
+/* Single producer, single consumer ring of timestamped records.
+ *
+ * The producer owns the tail and the consumer owns the head. Both are
+ * byte counters: the offset into the buffer is the counter modulo the
+ * buffer size. Records are never split: if a record does not fit before
+ * the end of the buffer, the remainder is skipped.
+ *
+ * The mutex and condition variable are used only to sleep when the ring
+ * is full or empty.
+ */
+
+typedef struct {
+  struct timespec ts;
+  size_t len;
+  int tag;
+} tsring_hdr_t;
+
+#define TSRING_ALIGN(n) (((n) + 7) & ~(size_t)7)
+#define TSRING_HDR TSRING_ALIGN(sizeof(tsring_hdr_t))
+#define TSRING_WRAP ((size_t)-1)
+
+static int tsring_wait(tsring_t *q, int timeout);
+static void tsring_wake(tsring_t *q);
+static size_t tsring_skip(tsring_t *q, size_t head);
+
+int tsring_init(tsring_t *q, size_t size) {
+  pthread_condattr_t attr;
+
+  (void)memset(q, 0, sizeof(*q));
+
+  q->size = size & ~(size_t)7;
+  if (q->size < TSRING_HDR * 2) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  q->buf = malloc(q->size);
+  if (q->buf == NULL)
+    return -1;
+
+  if (pthread_mutex_init(&q->lock, NULL) != 0)
+    return -1;
+
+  if (pthread_condattr_init(&attr) != 0 ||
+      pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&q->cond, &attr) != 0)
+    return -1;
+
+  (void)pthread_condattr_destroy(&attr);
+
+  return 0;
+}
+
+void tsring_free(tsring_t *q) {
+  (void)pthread_cond_destroy(&q->cond);
+  (void)pthread_mutex_destroy(&q->lock);
+  free(q->buf);
+  q->buf = NULL;
+}
+
+/* Copy a record into the ring, waiting for space.
+ *
+ * tag: caller defined value returned with the record
+ */
+int tsring_put(tsring_t *q, const struct timespec *ts, int tag,
+               const char *buf, size_t len) {
+  size_t need = TSRING_ALIGN(TSRING_HDR + len);
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  size_t off = tail % q->size;
+  size_t pad = 0;
+  tsring_hdr_t hdr;
+
+  if (need > q->size / 2) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  if (q->size - off < need)
+    pad = q->size - off;
+
+  while (tail + pad + need - atomic_load(&q->head) > q->size) {
+    if (atomic_load(&q->closed)) {
+      errno = EPIPE;
+      return -1;
+    }
+    (void)tsring_wait(q, -1);
+  }
+
+  if (pad > 0) {
+    if (pad >= TSRING_HDR) {
+      hdr.len = TSRING_WRAP;
+      (void)memcpy(q->buf + off, &hdr, sizeof(hdr));
+    }
+    tail += pad;
+    off = 0;
+  }
+
+  hdr.ts = *ts;
+  hdr.len = len;
+  hdr.tag = tag;
+  (void)memcpy(q->buf + off, &hdr, sizeof(hdr));
+  (void)memcpy(q->buf + off + TSRING_HDR, buf, len);
+
+  atomic_store(&q->tail, tail + need);
+  tsring_wake(q);
+
+  return 0;
+}
+
+/* Return the next record in the ring.
+ *
+ * The record remains in the ring until tsring_pop() is called.
+ *
+ * timeout: milliseconds to wait for a record or -1 to wait indefinitely
+ *
+ * Returns the record length, 0 if the ring is closed and empty or -1 with
+ * errno set to ETIMEDOUT.
+ */
+ssize_t tsring_get(tsring_t *q, struct timespec *ts, int *tag, char **buf,
+                   int timeout) {
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  tsring_hdr_t hdr;
+
+  while (atomic_load(&q->tail) == head) {
+    if (atomic_load(&q->closed)) {
+      if (atomic_load(&q->tail) != head)
+        break;
+      return 0;
+    }
+    if (tsring_wait(q, timeout) == ETIMEDOUT &&
+        atomic_load(&q->tail) == head) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+  }
+
+  head = tsring_skip(q, head);
+
+  (void)memcpy(&hdr, q->buf + head % q->size, sizeof(hdr));
+  *ts = hdr.ts;
+  *tag = hdr.tag;
+  *buf = q->buf + head % q->size + TSRING_HDR;
+
+  return hdr.len;
+}
+
+void tsring_pop(tsring_t *q) {
+  size_t head = tsring_skip(
+      q, atomic_load_explicit(&q->head, memory_order_relaxed));
+  tsring_hdr_t hdr;
+
+  (void)memcpy(&hdr, q->buf + head % q->size, sizeof(hdr));
+
+  atomic_store(&q->head, head + TSRING_ALIGN(TSRING_HDR + hdr.len));
+  tsring_wake(q);
+}
+
+/* No more records will be added. */
+void tsring_close(tsring_t *q) {
+  atomic_store(&q->closed, 1);
+
+  (void)pthread_mutex_lock(&q->lock);
+  (void)pthread_cond_broadcast(&q->cond);
+  (void)pthread_mutex_unlock(&q->lock);
+}
+
+/* Skip padding at the end of the buffer. */
+static size_t tsring_skip(tsring_t *q, size_t head) {
+  size_t off = head % q->size;
+  tsring_hdr_t hdr;
+
+  if (q->size - off >= TSRING_HDR) {
+    (void)memcpy(&hdr, q->buf + off, sizeof(hdr));
+    if (hdr.len != TSRING_WRAP)
+      return head;
+  }
+
+  return head + q->size - off;
+}
+
+/* Sleep until the other side of the ring makes progress.
+ *
+ * The waiter count is raised before the ring is checked again with the
+ * lock held: either the other side sees the waiter and signals after the
+ * wait begins or the check sees the update.
+ */
+static int tsring_wait(tsring_t *q, int timeout) {
+  struct timespec abstime;
+  size_t head = atomic_load(&q->head);
+  size_t tail = atomic_load(&q->tail);
+  int rv = 0;
+
+  if (timeout >= 0) {
+    (void)clock_gettime(CLOCK_MONOTONIC, &abstime);
+    abstime.tv_sec += timeout / 1000;
+    abstime.tv_nsec += (timeout % 1000) * 1000000L;
+    if (abstime.tv_nsec >= 1000000000L) {
+      abstime.tv_sec++;
+      abstime.tv_nsec -= 1000000000L;
+    }
+  }
+
+  (void)pthread_mutex_lock(&q->lock);
+  atomic_fetch_add(&q->waiters, 1);
+
+  while (rv == 0 && !atomic_load(&q->closed) &&
+         atomic_load(&q->head) == head && atomic_load(&q->tail) == tail) {
+    rv = timeout < 0 ? pthread_cond_wait(&q->cond, &q->lock)
+                     : pthread_cond_timedwait(&q->cond, &q->lock, &abstime);
+  }
+
+  atomic_fetch_sub(&q->waiters, 1);
+  (void)pthread_mutex_unlock(&q->lock);
+
+  return rv;
+}
+
+static void tsring_wake(tsring_t *q) {
+  if (atomic_load(&q->waiters) == 0)
+    return;
+
+  (void)pthread_mutex_lock(&q->lock);
+  (void)pthread_cond_broadcast(&q->cond);
+  (void)pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,26 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define TSRING_SIZE (1024 * 1024)
+
+typedef struct {
+  char *buf;
+  size_t size;
+  atomic_size_t head;
+  atomic_size_t tail;
+  atomic_int waiters;
+  atomic_int closed;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} tsring_t;
+
+int tsring_init(tsring_t *q, size_t size);
+void tsring_free(tsring_t *q);
+int tsring_put(tsring_t *q, const struct timespec *ts, int tag,
+               const char *buf, size_t len);
+ssize_t tsring_get(tsring_t *q, struct timespec *ts, int *tag, char **buf,
+                   int timeout);
+void tsring_pop(tsring_t *q);
+void tsring_close(tsring_t *q);
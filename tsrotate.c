@@ -0,0 +1,205 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tsrotate.h"
+
+static int tsrotate_openat(tsrotate_t *r);
+static void tsrotate_preallocate(tsrotate_t *r);
+static void tsrotate_deadline(tsrotate_t *r);
+static const char *tsrotate_name(const tsrotate_t *r, char *buf, int n);
+
+/* Open the output file: the size, interval and count must be set.
+ *
+ * The directory remains open: after the process is restricted, files are
+ * only opened and renamed relative to the directory.
+ */
+int tsrotate_open(tsrotate_t *r, const char *path) {
+  const char *name;
+  struct stat sb;
+
+  name = strrchr(path, '/');
+  name = (name == NULL) ? path : name + 1;
+
+  if (*name == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+    errno = EISDIR;
+    return -1;
+  }
+
+  /* the directory of "/name" is "/" */
+  if (name == path)
+    r->dir = strdup(".");
+  else
+    r->dir = strndup(path, name - path == 1 ? 1 : name - path - 1);
+  r->name = strdup(name);
+  /* <name>.<count> */
+  r->namelen = strlen(name) + 1 + 11 + 1;
+  r->from = malloc(r->namelen);
+  r->to = malloc(r->namelen);
+
+  if (r->dir == NULL || r->name == NULL || r->from == NULL || r->to == NULL)
+    return -1;
+
+  r->dirfd = open(r->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (r->dirfd < 0)
+    return -1;
+
+  r->fd = openat(r->dirfd, r->name, TSROTATE_FLAGS, 0666);
+  if (r->fd < 0)
+    return -1;
+
+  if (fstat(r->fd, &sb) < 0)
+    return -1;
+
+  if (!S_ISREG(sb.st_mode)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  r->written = sb.st_size;
+
+  tsrotate_preallocate(r);
+  tsrotate_deadline(r);
+
+  return 0;
+}
+
+/* The descriptor number used to open the next file: the lowest unused
+ * descriptor. No descriptors may be opened or closed until the process
+ * is restricted.
+ */
+int tsrotate_reserve(tsrotate_t *r) {
+  r->spare = dup(r->fd);
+  if (r->spare < 0)
+    return -1;
+
+  return close(r->spare);
+}
+
+/* The file is rotated before writing a record of n bytes if the record
+ * would exceed the size or the interval has elapsed. Empty files are not
+ * rotated.
+ */
+int tsrotate_due(const tsrotate_t *r, size_t n) {
+  struct timespec now;
+
+  if (r->written == 0)
+    return 0;
+
+  if (r->size > 0 && r->written + n > r->size)
+    return 1;
+
+  if (r->interval == 0 || clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+    return 0;
+
+  return now.tv_sec > r->deadline.tv_sec ||
+         (now.tv_sec == r->deadline.tv_sec &&
+          now.tv_nsec >= r->deadline.tv_nsec);
+}
+
+/* Rotate the file: any buffered data must be written first. */
+int tsrotate(tsrotate_t *r) {
+  int n;
+
+  /* Failures are ignored: the file may not permit truncation. */
+  (void)tsrotate_trim(r);
+
+  /* <name>.<n> -> <name>.<n+1>: the oldest file is replaced */
+  for (n = r->count - 1; n >= 0; n--) {
+    if (renameat(r->dirfd, tsrotate_name(r, r->from, n), r->dirfd,
+                 tsrotate_name(r, r->to, n + 1)) < 0 &&
+        errno != ENOENT)
+      return -1;
+  }
+
+  if (tsrotate_openat(r) < 0)
+    return -1;
+
+  r->written = 0;
+
+  tsrotate_preallocate(r);
+  tsrotate_deadline(r);
+
+  return 0;
+}
+
+/* Open the new file on the descriptor number of the current file. */
+static int tsrotate_openat(tsrotate_t *r) {
+  int fd;
+
+  fd = openat(r->dirfd, r->name, TSROTATE_FLAGS, 0666);
+  if (fd < 0)
+    return -1;
+
+  if (dup2(fd, r->fd) < 0) {
+    (void)close(fd);
+    return -1;
+  }
+
+  (void)close(fd);
+
+  return 0;
+}
+
+/* Linux: reserve space for the file without changing the file size.
+ * Failures are ignored: not all filesystems support preallocation.
+ */
+static void tsrotate_preallocate(tsrotate_t *r) {
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (r->size > r->written)
+    (void)fallocate(r->fd, FALLOC_FL_KEEP_SIZE, r->written,
+                    r->size - r->written);
+#else
+  (void)r;
+#endif
+}
+
+/* Release any space preallocated beyond the end of the file: called
+ * before rotating and after the last write.
+ */
+int tsrotate_trim(tsrotate_t *r) {
+  struct stat sb;
+
+  if (fstat(r->fd, &sb) < 0)
+    return -1;
+
+  return ftruncate(r->fd, sb.st_size);
+}
+
+static void tsrotate_deadline(tsrotate_t *r) {
+  if (r->interval == 0 ||
+      clock_gettime(CLOCK_MONOTONIC, &r->deadline) < 0)
+    return;
+
+  r->deadline.tv_sec += r->interval;
+}
+
+/* <name> or <name>.<n> */
+static const char *tsrotate_name(const tsrotate_t *r, char *buf, int n) {
+  if (n == 0)
+    return r->name;
+
+  (void)snprintf(buf, r->namelen, "%s.%d", r->name, n);
+  return buf;
+}
@@ -0,0 +1,34 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* open(2) flags of the output files */
+#define TSROTATE_FLAGS (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC)
+
+/* Rotated output file.
+ *
+ * The file is written with O_APPEND. When rotated, the file is renamed to
+ * <name>.1, any older files are shifted up to <name>.<count> and a new
+ * file is opened on the same descriptor number.
+ */
+typedef struct {
+  int dirfd;
+  int fd;
+  int spare;
+  char *dir;
+  char *name;
+  char *from;
+  char *to;
+  size_t namelen;
+  size_t size;
+  int interval;
+  int count;
+  size_t written;
+  struct timespec deadline;
+} tsrotate_t;
+
+int tsrotate_open(tsrotate_t *r, const char *path);
+int tsrotate_reserve(tsrotate_t *r);
+int tsrotate_due(const tsrotate_t *r, size_t n);
+int tsrotate(tsrotate_t *r);
+int tsrotate_trim(tsrotate_t *r);
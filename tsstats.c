@@ -0,0 +1,79 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <stdio.h>
+
+#include "tsstats.h"
+
+/* Counters have a single writer: an update is a relaxed load and store,
+ * not a locked read-modify-write. Readers in other threads see a recent
+ * value.
+ */
+void tsstats_add(tsstats_counter_t *c, unsigned long long n) {
+  atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                        memory_order_relaxed);
+}
+
+unsigned long long tsstats_get(tsstats_counter_t *c) {
+  return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+void tsstats_latency(tsstats_t *st, long long usec) {
+  int n = 0;
+
+  while (usec > 0 && n < TSSTATS_BUCKETS - 1) {
+    usec >>= 1;
+    n++;
+  }
+
+  tsstats_add(&st->latency[n], 1);
+}
+
+/* Format the non-empty buckets of the latency histogram:
+ *
+ *   <1=10 <2=3 <1024=1 >=4194304=1
+ *
+ * Returns the length of the string.
+ */
+size_t tsstats_histogram(tsstats_t *st, char *buf, size_t size) {
+  size_t len = 0;
+  int n;
+  int i;
+
+  if (size == 0)
+    return 0;
+
+  buf[0] = '\0';
+
+  for (i = 0; i < TSSTATS_BUCKETS; i++) {
+    unsigned long long count = tsstats_get(&st->latency[i]);
+
+    if (count == 0)
+      continue;
+
+    n = i == TSSTATS_BUCKETS - 1
+            ? snprintf(buf + len, size - len, "%s>=%llu=%llu",
+                       len == 0 ? "" : " ", 1ULL << (i - 1), count)
+            : snprintf(buf + len, size - len, "%s<%llu=%llu",
+                       len == 0 ? "" : " ", 1ULL << i, count);
+    if (n < 0 || (size_t)n >= size - len) {
+      buf[len] = '\0';
+      break;
+    }
+
+    len += n;
+  }
+
+  return len;
+}
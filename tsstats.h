@@ -0,0 +1,21 @@
+#include <stdatomic.h>
+#include <stddef.h>
+
+/* Latency histogram: bucket n counts latencies of less than 2^n
+ * microseconds. The last bucket counts any larger latency.
+ */
+#define TSSTATS_BUCKETS 24
+
+typedef atomic_ullong tsstats_counter_t;
+
+typedef struct {
+  tsstats_counter_t lines;
+  tsstats_counter_t bytes;
+  tsstats_counter_t suppressed;
+  tsstats_counter_t latency[TSSTATS_BUCKETS];
+} tsstats_t;
+
+void tsstats_add(tsstats_counter_t *c, unsigned long long n);
+unsigned long long tsstats_get(tsstats_counter_t *c);
+void tsstats_latency(tsstats_t *st, long long usec);
+size_t tsstats_histogram(tsstats_t *st, char *buf, size_t size);
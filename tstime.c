@@ -0,0 +1,188 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "tstime.h"
+
+/* The next transition is searched for a year, checking the offset once a
+ * day.
+ */
+#define TSTIME_HORIZON (366 * 86400L)
+#define TSTIME_STEP 86400
+
+static int tstime_same(const tstime_zone_t *z, const struct tm *tm);
+static void tstime_zone(tstime_zone_t *z, time_t start, const struct tm *tm);
+static struct tm *tstime_civil(time_t sec, const tstime_zone_t *z,
+                               struct tm *tm);
+
+/* Build a table of the UTC offset in effect now and the offset following
+ * the next transition. The table ends a day after the transition or at
+ * the end of the horizon.
+ *
+ * Must be called before process restrictions are enabled: localtime(3)
+ * reads the timezone database.
+ */
+int tstime_init(tstime_t *t, time_t now) {
+  struct tm tm;
+  time_t sec;
+  time_t end;
+
+  (void)memset(t, 0, sizeof(*t));
+
+  if (localtime_r(&now, &tm) == NULL)
+    return -1;
+
+  tstime_zone(&t->zone[t->nzone++], now, &tm);
+
+  end = now + TSTIME_HORIZON;
+  if (end < now)
+    end = now;
+
+  for (sec = now; sec < end && t->nzone < TSTIME_MAXZONE;
+       sec += TSTIME_STEP) {
+    time_t lo = sec;
+    time_t hi = sec + TSTIME_STEP;
+
+    if (localtime_r(&hi, &tm) == NULL)
+      return -1;
+
+    if (tstime_same(&t->zone[t->nzone - 1], &tm))
+      continue;
+
+    while (hi - lo > 1) {
+      time_t mid = lo + (hi - lo) / 2;
+
+      if (localtime_r(&mid, &tm) == NULL)
+        return -1;
+
+      if (tstime_same(&t->zone[t->nzone - 1], &tm))
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    if (localtime_r(&hi, &tm) == NULL)
+      return -1;
+
+    tstime_zone(&t->zone[t->nzone++], hi, &tm);
+  }
+
+  t->end = sec;
+
+  return 0;
+}
+
+/* Rebuild the table from the current time once the end of the table has
+ * passed. The timezone database was read by tstime_init().
+ */
+int tstime_update(tstime_t *t, time_t now) {
+  if (t->utc || now < t->end)
+    return 0;
+
+  return tstime_init(t, now);
+}
+
+/* Convert seconds since the epoch to local time.
+ *
+ * Times covered by the transition table are converted using integer
+ * arithmetic. Anything outside of the table falls back to localtime(3).
+ */
+struct tm *tstime_localtime(const tstime_t *t, time_t sec, struct tm *tm) {
+  static const tstime_zone_t utc = {0, 0, 0, "UTC"};
+  size_t lo;
+  size_t hi;
+
+  if (t->utc)
+    return tstime_civil(sec, &utc, tm);
+
+  if (t->nzone == 0 || sec < t->zone[0].start || sec >= t->end)
+    return localtime_r(&sec, tm);
+
+  lo = 0;
+  hi = t->nzone;
+
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (t->zone[mid].start <= sec)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return tstime_civil(sec, &t->zone[lo], tm);
+}
+
+static int tstime_same(const tstime_zone_t *z, const struct tm *tm) {
+  return z->gmtoff == tm->tm_gmtoff && z->isdst == tm->tm_isdst &&
+         (tm->tm_zone == NULL || strcmp(z->name, tm->tm_zone) == 0);
+}
+
+static void tstime_zone(tstime_zone_t *z, time_t start, const struct tm *tm) {
+  z->start = start;
+  z->gmtoff = tm->tm_gmtoff;
+  z->isdst = tm->tm_isdst;
+  if (tm->tm_zone != NULL)
+    (void)snprintf(z->name, sizeof(z->name), "%s", tm->tm_zone);
+}
+
+/* days to civil date: http://howardhinnant.github.io/date_algorithms.html */
+static struct tm *tstime_civil(time_t sec, const tstime_zone_t *z,
+                               struct tm *tm) {
+  long long t = (long long)sec + z->gmtoff;
+  long long days = t / 86400;
+  long long rem = t % 86400;
+  long long era;
+  long long doe;
+  long long yoe;
+  long long doy;
+  long long mp;
+  long long y;
+  int leap;
+
+  if (rem < 0) {
+    rem += 86400;
+    days--;
+  }
+
+  tm->tm_hour = rem / 3600;
+  tm->tm_min = rem / 60 % 60;
+  tm->tm_sec = rem % 60;
+
+  tm->tm_wday = (days + 4) % 7;
+  if (tm->tm_wday < 0)
+    tm->tm_wday += 7;
+
+  days += 719468;
+  era = (days >= 0 ? days : days - 146096) / 146097;
+  doe = days - era * 146097;
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  y = yoe + era * 400 + (mp >= 10);
+
+  leap = (y % 4 == 0) && (y % 100 != 0 || y % 400 == 0);
+
+  tm->tm_year = y - 1900;
+  tm->tm_mon = mp < 10 ? mp + 2 : mp - 10;
+  tm->tm_mday = doy - (153 * mp + 2) / 5 + 1;
+  tm->tm_yday = mp < 10 ? doy + 59 + leap : doy - 306;
+  tm->tm_isdst = z->isdst;
+  tm->tm_gmtoff = z->gmtoff;
+  tm->tm_zone = (char *)z->name;
+
+  return tm;
+}
@@ -0,0 +1,23 @@
+#include <sys/types.h>
+#include <time.h>
+
+/* the current offset and the offset after the next transition */
+#define TSTIME_MAXZONE 2
+
+typedef struct {
+  time_t start;
+  long gmtoff;
+  int isdst;
+  char name[16];
+} tstime_zone_t;
+
+typedef struct {
+  tstime_zone_t zone[TSTIME_MAXZONE];
+  size_t nzone;
+  time_t end;
+  int utc;
+} tstime_t;
+
+int tstime_init(tstime_t *t, time_t now);
+int tstime_update(tstime_t *t, time_t now);
+struct tm *tstime_localtime(const tstime_t *t, time_t sec, struct tm *tm);
@@ -0,0 +1,287 @@
+/* Copyright (c) 2020-2025, Michael Santos <michael.santos@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tsuring.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(IORING_SETUP_R_DISABLED) &&              \
+    defined(__NR_io_uring_setup)
+static int tsuring_setup(unsigned entries, struct io_uring_params *p);
+static int tsuring_register(int fd, unsigned op, void *arg, unsigned nargs);
+static int tsuring_restrict(int fd);
+static struct io_uring_sqe *tsuring_sqe(tsuring_t *u);
+
+/* The ring is created disabled and enabled after the operations are
+ * restricted to reads and writes: the restrictions cannot be changed.
+ *
+ * Returns -1 if io_uring is not supported or not permitted.
+ */
+int tsuring_init(tsuring_t *u, unsigned entries) {
+  struct io_uring_params p;
+
+  (void)memset(u, 0, sizeof(*u));
+  (void)memset(&p, 0, sizeof(p));
+
+  p.flags = IORING_SETUP_R_DISABLED;
+
+  u->fd = tsuring_setup(entries, &p);
+  if (u->fd < 0)
+    return -1;
+
+  u->sqringsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cqringsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->sqessz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  u->sqring = mmap(NULL, u->sqringsz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->sqring == MAP_FAILED)
+    goto ERR;
+
+  u->cqring = mmap(NULL, u->cqringsz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+  if (u->cqring == MAP_FAILED)
+    goto ERR;
+
+  u->sqes = mmap(NULL, u->sqessz, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED)
+    goto ERR;
+
+  u->sqhead = (unsigned *)((char *)u->sqring + p.sq_off.head);
+  u->sqtail = (unsigned *)((char *)u->sqring + p.sq_off.tail);
+  u->sqmask = (unsigned *)((char *)u->sqring + p.sq_off.ring_mask);
+  u->sqarray = (unsigned *)((char *)u->sqring + p.sq_off.array);
+  u->sqentries = p.sq_entries;
+
+  u->cqhead = (unsigned *)((char *)u->cqring + p.cq_off.head);
+  u->cqtail = (unsigned *)((char *)u->cqring + p.cq_off.tail);
+  u->cqmask = (unsigned *)((char *)u->cqring + p.cq_off.ring_mask);
+  u->cqes = (char *)u->cqring + p.cq_off.cqes;
+
+  if (tsuring_restrict(u->fd) < 0)
+    goto ERR;
+
+  return 0;
+
+ERR:
+  tsuring_free(u);
+  return -1;
+}
+
+void tsuring_free(tsuring_t *u) {
+  int oerrno = errno;
+
+  if (u->sqes != NULL && u->sqes != MAP_FAILED)
+    (void)munmap(u->sqes, u->sqessz);
+  if (u->cqring != NULL && u->cqring != MAP_FAILED)
+    (void)munmap(u->cqring, u->cqringsz);
+  if (u->sqring != NULL && u->sqring != MAP_FAILED)
+    (void)munmap(u->sqring, u->sqringsz);
+
+  (void)close(u->fd);
+
+  (void)memset(u, 0, sizeof(*u));
+  u->fd = -1;
+
+  errno = oerrno;
+}
+
+/* Queue a read at the current file position. */
+int tsuring_read(tsuring_t *u, int fd, void *buf, size_t len, uint64_t data) {
+  struct io_uring_sqe *sqe;
+
+  sqe = tsuring_sqe(u);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->off = (uint64_t)-1;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->user_data = data;
+
+  return 0;
+}
+
+/* Queue a write at the current file position. The iovec must remain
+ * valid until the request completes.
+ */
+int tsuring_writev(tsuring_t *u, int fd, const struct iovec *iov, int iovcnt,
+                   uint64_t data) {
+  struct io_uring_sqe *sqe;
+
+  sqe = tsuring_sqe(u);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = fd;
+  sqe->off = (uint64_t)-1;
+  sqe->addr = (uint64_t)(uintptr_t)iov;
+  sqe->len = iovcnt;
+  sqe->user_data = data;
+
+  return 0;
+}
+
+/* Submit any queued requests and wait for completions.
+ *
+ * wait: number of completions to wait for
+ */
+int tsuring_enter(tsuring_t *u, unsigned wait) {
+  long rv;
+
+  for (;;) {
+    rv = syscall(__NR_io_uring_enter, u->fd, u->queued, wait,
+                 wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (rv < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    if (rv == 0 && u->queued > 0) {
+      errno = EBUSY;
+      return -1;
+    }
+
+    u->queued -= rv;
+
+    if (u->queued == 0)
+      return 0;
+  }
+}
+
+/* Remove a completion: res is the result of the request or a negative
+ * errno.
+ *
+ * Returns 1 if a request completed or 0 if no completions are pending.
+ */
+int tsuring_reap(tsuring_t *u, uint64_t *data, int *res) {
+  unsigned head = *u->cqhead;
+  struct io_uring_cqe *cqe;
+
+  if (head == __atomic_load_n(u->cqtail, __ATOMIC_ACQUIRE))
+    return 0;
+
+  cqe = (struct io_uring_cqe *)u->cqes + (head & *u->cqmask);
+  *data = cqe->user_data;
+  *res = cqe->res;
+
+  __atomic_store_n(u->cqhead, head + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+static int tsuring_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int tsuring_register(int fd, unsigned op, void *arg, unsigned nargs) {
+  return syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+static int tsuring_restrict(int fd) {
+  struct io_uring_restriction res[2];
+
+  (void)memset(res, 0, sizeof(res));
+
+  res[0].opcode = IORING_RESTRICTION_SQE_OP;
+  res[0].sqe_op = IORING_OP_READ;
+  res[1].opcode = IORING_RESTRICTION_SQE_OP;
+  res[1].sqe_op = IORING_OP_WRITEV;
+
+  if (tsuring_register(fd, IORING_REGISTER_RESTRICTIONS, res, 2) < 0)
+    return -1;
+
+  return tsuring_register(fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0);
+}
+
+static struct io_uring_sqe *tsuring_sqe(tsuring_t *u) {
+  unsigned tail = *u->sqtail;
+  unsigned head = __atomic_load_n(u->sqhead, __ATOMIC_ACQUIRE);
+  struct io_uring_sqe *sqe;
+  unsigned i;
+
+  if (tail - head >= u->sqentries) {
+    errno = EBUSY;
+    return NULL;
+  }
+
+  i = tail & *u->sqmask;
+  sqe = (struct io_uring_sqe *)u->sqes + i;
+  (void)memset(sqe, 0, sizeof(*sqe));
+
+  u->sqarray[i] = i;
+  __atomic_store_n(u->sqtail, tail + 1, __ATOMIC_RELEASE);
+  u->queued++;
+
+  return sqe;
+}
+#else
+int tsuring_init(tsuring_t *u, unsigned entries) {
+  (void)memset(u, 0, sizeof(*u));
+  (void)entries;
+  u->fd = -1;
+  errno = ENOSYS;
+  return -1;
+}
+
+void tsuring_free(tsuring_t *u) { (void)u; }
+
+int tsuring_read(tsuring_t *u, int fd, void *buf, size_t len, uint64_t data) {
+  (void)u;
+  (void)fd;
+  (void)buf;
+  (void)len;
+  (void)data;
+  errno = ENOSYS;
+  return -1;
+}
+
+int tsuring_writev(tsuring_t *u, int fd, const struct iovec *iov, int iovcnt,
+                   uint64_t data) {
+  (void)u;
+  (void)fd;
+  (void)iov;
+  (void)iovcnt;
+  (void)data;
+  errno = ENOSYS;
+  return -1;
+}
+
+int tsuring_enter(tsuring_t *u, unsigned wait) {
+  (void)u;
+  (void)wait;
+  errno = ENOSYS;
+  return -1;
+}
+
+int tsuring_reap(tsuring_t *u, uint64_t *data, int *res) {
+  (void)u;
+  (void)data;
+  (void)res;
+  return 0;
+}
+#endif
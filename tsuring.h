@@ -0,0 +1,36 @@
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Linux io_uring: a ring limited to reads and writes.
+ *
+ * Requests are queued and submitted together by tsuring_enter(). The
+ * user data identifies the request on completion.
+ */
+typedef struct {
+  int fd;
+  unsigned *sqhead;
+  unsigned *sqtail;
+  unsigned *sqmask;
+  unsigned *sqarray;
+  unsigned sqentries;
+  unsigned *cqhead;
+  unsigned *cqtail;
+  unsigned *cqmask;
+  void *sqes;
+  void *cqes;
+  void *sqring;
+  size_t sqringsz;
+  void *cqring;
+  size_t cqringsz;
+  size_t sqessz;
+  unsigned queued;
+} tsuring_t;
+
+int tsuring_init(tsuring_t *u, unsigned entries);
+void tsuring_free(tsuring_t *u);
+int tsuring_read(tsuring_t *u, int fd, void *buf, size_t len, uint64_t data);
+int tsuring_writev(tsuring_t *u, int fd, const struct iovec *iov, int iovcnt,
+                   uint64_t data);
+int tsuring_enter(tsuring_t *u, unsigned wait);
+int tsuring_reap(tsuring_t *u, uint64_t *data, int *res);